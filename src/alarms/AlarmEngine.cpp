@@ -0,0 +1,644 @@
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+#include "AlarmEngine.h"
+#include "utils/benchmark.h"
+#include "utils/log.h"
+
+namespace {
+const auto alarmShards = 16;
+
+/** @brief Move a timestamp which might be updated concurrently forward, but never backward */
+void advance(std::atomic<alarms::TimePoint>& lastChanged, const alarms::TimePoint time)
+{
+    auto current = lastChanged.load();
+    while (current < time && !lastChanged.compare_exchange_weak(current, time)) {
+    }
+}
+}
+
+namespace alarms {
+
+/** @short Propagate an alarm update into the cached alarm info
+ *
+ * The entry that's being modified might not have existed in the cache. In that case, it's a new alarm,
+ * and this function is called on a default-constructed AlarmEntry.
+ *
+ * Updates of a damped alarm are held: the alarm changes, but there is no status-change entry and no notification.
+ * These are left for the next summary update of that alarm.
+ * */
+AlarmEntry::WhatChanged AlarmEntry::update(
+        const bool wasPresent,
+        const TimePoint now,
+        const int32_t severity,
+        const std::string& text,
+        const std::optional<std::string> shelf,
+        const NotifyStatusChanges notifyStatusChanges,
+        const std::optional<int32_t> notifySeverityThreshold,
+        const std::optional<uint16_t> maxAlarmStatusChanges,
+        const bool held)
+{
+    const bool isClearedNow = severity == ClearedSeverity;
+
+    // If the update clears and alarm and that alarm was not present before, we don't know
+    // what to store into the `isCleared`. This must be handled prior to default-constructing
+    // the new entry in m_alarms in AlarmEngine::update.
+    assert(!isClearedNow || wasPresent);
+
+    WhatChanged res {
+        .changed = false,
+        .shouldNotify = false,
+        .removedStatusChange = std::nullopt,
+    };
+
+    if (!wasPresent) {
+        // Shelving status does not depend on "alarm updates" (which are handled here); whether an alarm is shelved
+        // or not shelved is only determined by the /ietf-alarms:alarms/control/alarm-shelving.
+        // We don't have to track updates here.
+        this->shelf = shelf;
+
+        // this one only gets assigned at the very beginning of an alarm lifetime
+        this->created = now;
+
+        // -1 is an invalid value which compares different to anything legal later on
+        this->lastSeverity = -1;
+
+        this->statusChanges.setLimit(maxAlarmStatusChanges, [](const TimePoint&) {});
+    }
+    // existing alarms are updated by AlarmEngine::resizeStatusChangesLists whenever the limit changes
+    assert(this->statusChanges.limit() == maxAlarmStatusChanges);
+
+    if (wasPresent && this->isCleared != isClearedNow) {
+        res.changed = true;
+    }
+
+    if (text != this->text) {
+        this->text = text;
+        res.changed = true;
+    }
+
+    if (isClearedNow || notifyStatusChanges == NotifyStatusChanges::All) {
+        res.shouldNotify = true;
+    } else if (notifyStatusChanges == NotifyStatusChanges::RaiseAndClear) {
+        res.shouldNotify = !wasPresent || (isClearedNow != this->isCleared);
+    }
+
+    if (severity != this->lastSeverity /* evaluates true also for previously unseen alarm keys */) {
+        res.changed = true;
+    }
+
+    if (!isClearedNow) {
+        if (!wasPresent || (wasPresent && this->isCleared)) {
+            this->lastRaised = now;
+        }
+        if (notifyStatusChanges == NotifyStatusChanges::BySeverity &&
+                (severity >= *notifySeverityThreshold || this->lastSeverity >= *notifySeverityThreshold)) {
+            res.shouldNotify = true;
+        }
+        if (severity > ClearedSeverity) {
+            this->lastSeverity = severity;
+        }
+    }
+    this->isCleared = severity == ClearedSeverity;
+
+    if (res.changed) {
+        this->lastChanged = now;
+
+        if (held) {
+            res.shouldNotify = false;
+            return res;
+        }
+        res.removedStatusChange = this->statusChanges.push({now, this->isCleared ? ClearedSeverity : this->lastSeverity, this->text});
+    }
+
+    return res;
+}
+
+AlarmEngine::AlarmEngine(Events& events, const std::optional<FlapDamping>& flapDamping, const std::optional<std::filesystem::path>& stateDirectory)
+    : m_events(events)
+    , m_log(spdlog::get("main"))
+    , m_alarms(alarmShards)
+    , m_alarmListLastChanged(TimePoint::clock::now())
+    , m_shelfListLastChanged(TimePoint::clock::now())
+    , m_flapDamping(flapDamping)
+{
+    if (stateDirectory) {
+        m_store.emplace(*stateDirectory);
+    }
+    if (m_flapDamping) {
+        m_log->info("Flap damping: penalty half-life {}ms, updates of flapping alarms summarized once per {}ms", m_flapDamping->halfLife.count(), m_flapDamping->summaryInterval.count());
+    }
+}
+
+AlarmEngine::~AlarmEngine()
+{
+    if (m_store) {
+        // nothing is left to replay on the next start
+        auto shards = m_alarms.lockAll();
+        snapshot();
+    }
+}
+
+/** @brief Find the index of an alarm-type-id in the identity table */
+std::optional<IdentityTable::Index> AlarmEngine::findIdentity(const std::string& alarmTypeId)
+{
+    std::shared_lock cfg{m_configMtx};
+    return m_identities.find(alarmTypeId);
+}
+
+/** @brief Learn about new alarm type identities, e.g., when the schema has changed */
+bool AlarmEngine::learnIdentities(const libyang::Context& ctx)
+{
+    std::unique_lock cfg{m_configMtx};
+    return m_identities.update(ctx);
+}
+
+ShelvingRules AlarmEngine::compileShelvingRules(const libyang::Set<libyang::DataNode>& shelves)
+{
+    std::shared_lock cfg{m_configMtx};
+    return ShelvingRules{shelves, m_identities};
+}
+
+AlarmEngine::Settings AlarmEngine::settings()
+{
+    std::shared_lock cfg{m_configMtx};
+    return m_settings;
+}
+
+/** @short Apply new settings, and new shelving rules if there are any, to all alarms
+ *
+ * @return whether any alarms have changed
+ * */
+bool AlarmEngine::reconfigure(const Settings& settings, std::optional<ShelvingRules>&& shelvingRules)
+{
+    std::unique_lock cfg{m_configMtx};
+    const bool needsReshelve = !!shelvingRules;
+    const bool needsStatusChangesResize = settings.maxAlarmStatusChanges != m_settings.maxAlarmStatusChanges;
+    m_settings = settings;
+    if (needsReshelve) {
+        m_shelvingRules = std::move(*shelvingRules);
+    }
+    if (!needsReshelve && !needsStatusChangesResize) {
+        return false;
+    }
+
+    auto shards = m_alarms.lockAll();
+    bool changed = false;
+    if (needsReshelve) {
+        changed |= reshelve();
+    }
+    if (needsStatusChangesResize) {
+        changed |= resizeStatusChangesLists();
+    }
+    if (changed) {
+        verifyStatistics();
+        if (m_store) {
+            snapshot();
+        }
+    }
+    return changed;
+}
+
+/** @brief Load the alarms which were persisted by the previous run. Must be called before anything else can access m_alarms. */
+void AlarmEngine::restore()
+{
+    if (!m_store) {
+        return;
+    }
+
+    WITH_TIME_MEASUREMENT{};
+    auto restored = m_store->load();
+    for (auto& [key, entry] : restored) {
+        auto alarmKey = key;
+        alarmKey.type.identity = m_identities.find(alarmKey.type.id);
+        auto& shard = m_alarms.shardFor(alarmKey);
+        auto& alarm = shard.alarms.tryEmplace(alarmKey).first;
+        alarm = std::move(entry);
+        countChange(std::nullopt, Statistics::Contribution::of(alarm));
+        shard.alarms.reindex(alarmKey);
+        advance(alarm.shelf ? m_shelfListLastChanged : m_alarmListLastChanged, alarm.lastChanged);
+    }
+    m_log->info("Restored {} alarms", restored.size());
+
+    // the journal has been replayed, no need to do that again on the next start; a failure just means replaying it again
+    auto shards = m_alarms.lockAll();
+    snapshot();
+}
+
+/** @short Propagate a single alarm update into the cache
+ *
+ * The updates of a single alarm might come from several threads, and their timestamps are taken before the alarm is
+ * locked. So the timestamp of this update is moved past the last change of the alarm if needed, which keeps the
+ * status-change entries of each alarm in order and their keys unique.
+ *
+ * @return whether the update has been passed on via Events::alarmUpdated(), i.e., whether there is anything to publish
+ */
+bool AlarmEngine::update(const TimePoint received, const AlarmInput& input)
+{
+    const auto& alarmKey = input.key;
+    const bool isClearedNow = input.severity == ClearedSeverity;
+
+    std::shared_lock cfg{m_configMtx};
+    auto& shard = m_alarms.shardFor(alarmKey);
+    std::unique_lock shardLck{shard.mtx};
+
+    if (auto existing = shard.alarms.find(alarmKey); isClearedNow && (!existing || existing->isCleared)) {
+        m_log->trace("No update for already-cleared alarm {}", alarmKey.xpathIndex());
+        return false;
+    }
+
+    auto matchedShelf = m_shelvingRules.findMatchingShelf(alarmKey, m_identities);
+    auto [alarm, wasInserted] = shard.alarms.tryEmplace(alarmKey);
+    std::optional<Statistics::Contribution> counted;
+    if (!wasInserted) {
+        counted = Statistics::Contribution::of(alarm);
+    }
+    const auto now = wasInserted ? received : std::max(received, alarm.lastChanged + std::chrono::nanoseconds{1});
+
+    // the update which starts the damping still goes through, so that the alarm shows up as flapping right away
+    const bool held = alarm.flapping.damped;
+    bool startedDamping = false;
+    if (m_flapDamping && !wasInserted && alarm.isCleared != isClearedNow) {
+        startedDamping = alarm.flapping.flap(*m_flapDamping, now);
+    }
+
+    auto res = alarm.update(!wasInserted, now, input.severity, input.text, matchedShelf, m_settings.notifyStatusChanges, m_settings.notifySeverityThreshold, m_settings.maxAlarmStatusChanges, held);
+    countChange(counted, Statistics::Contribution::of(alarm));
+    shard.alarms.reindex(alarmKey);
+
+    if (!res.changed) {
+        shardLck.unlock();
+        checkStatistics();
+        return false;
+    }
+
+    advance(alarm.shelf ? m_shelfListLastChanged : m_alarmListLastChanged, alarm.lastChanged);
+
+    if (m_store) {
+        m_store->journalUpdate(alarmKey, alarm, !held);
+    }
+
+    if (held) {
+        // the alarm itself is passed on, so that its leaves agree with the summary and with last-changed
+        alarm.flapping.held = true;
+        m_log->trace("Holding the status change of flapping alarm {}", alarmKey.xpathIndex());
+    }
+
+    if (startedDamping) {
+        m_log->info("Alarm {} is flapping, its updates are summarized once per {}ms", alarmKey.xpathIndex(), m_flapDamping->summaryInterval.count());
+        std::unique_lock lck{m_dampedMtx};
+        m_dampedAlarms.insert(alarmKey);
+    }
+
+    // still under the shard lock, so that updates of the same alarm are passed on in order
+    AlarmChange change;
+    change.newStatusChange = !held;
+    change.removedStatusChange = res.removedStatusChange;
+    change.notify = res.shouldNotify;
+    change.dampingStarted = startedDamping;
+    m_events.alarmUpdated(alarmKey, alarm, change);
+    shardLck.unlock();
+    checkStatistics();
+    return true;
+}
+
+/** @short Remove all alarms in the alarm list (or in the shelved-alarms list) which match a filter
+ *
+ * @return the number of removed alarms
+ * */
+unsigned AlarmEngine::purge(const AlarmFilter& filter, const bool shelved, const TimePoint now)
+{
+    WITH_TIME_MEASUREMENT{};
+    unsigned purgedAlarms = 0;
+
+    auto shards = m_alarms.lockAll();
+
+    for (auto& shard : m_alarms) {
+        purgedAlarms += shard.alarms.eraseIf(filter.query(shelved), [&](const InstanceKey& index, const AlarmEntry& entry) {
+            if (shelved != !!entry.shelf) {
+                // when purging through the "shelved" RPC, only consider shelved list and vice verse
+                return false;
+            }
+            if (!filter.matches(index, entry)) {
+                return false;
+            }
+            countChange(Statistics::Contribution::of(entry), std::nullopt);
+            if (m_store) {
+                m_store->journalRemoval(index);
+            }
+            m_events.alarmRemoved(index, entry);
+            return true;
+        });
+    }
+
+    if (purgedAlarms) {
+        verifyStatistics();
+        if (shelved) {
+            m_shelfListLastChanged = now;
+        } else {
+            m_alarmListLastChanged = now;
+        }
+    }
+    return purgedAlarms;
+}
+
+/** @short Drop all status-change entries but the newest one of all alarms which match a filter
+ *
+ * @return the number of alarms which have lost any status-change entries
+ * */
+unsigned AlarmEngine::compress(const AlarmFilter& filter, const bool shelved)
+{
+    WITH_TIME_MEASUREMENT{};
+    unsigned compressedAlarms = 0;
+
+    auto shards = m_alarms.lockAll();
+
+    for (auto& shard : m_alarms) {
+        shard.alarms.forEach(filter.query(shelved), [&](const InstanceKey& key, AlarmEntry& alarm) {
+            if (shelved != !!alarm.shelf || !filter.matches(key, alarm)) {
+                return;
+            }
+
+            bool discarded = false;
+            alarm.statusChanges.keepNewest(1, [&](const TimePoint& time) {
+                discarded = true;
+                m_events.statusChangeRemoved(key, alarm, time);
+            });
+            if (discarded) {
+                ++compressedAlarms;
+                if (m_store) {
+                    m_store->journalAlarm(key, alarm);
+                }
+            }
+        });
+    }
+
+    return compressedAlarms;
+}
+
+/** @brief Apply the current shelving rules to all alarms. Must be called with m_configMtx and all shards locked. */
+bool AlarmEngine::reshelve()
+{
+    WITH_TIME_MEASUREMENT{};
+
+    auto now = std::chrono::system_clock::now();
+    bool change = false;
+
+    for (auto& shard : m_alarms) {
+        shard.alarms.forEach([&](const InstanceKey& alarmKey, AlarmEntry& alarm) {
+            const auto& shelf = m_shelvingRules.findMatchingShelf(alarmKey, m_identities);
+            if (alarm.shelf == shelf) {
+                return;
+            }
+
+            change = true;
+            auto previousShelf = alarm.shelf;
+            if (alarm.shelf && !shelf) {
+                const auto counted = Statistics::Contribution::of(alarm);
+                alarm.shelf = std::nullopt;
+                alarm.created = now;
+                countChange(counted, Statistics::Contribution::of(alarm));
+                shard.alarms.reindex(alarmKey);
+                m_alarmListLastChanged = now;
+                m_shelfListLastChanged = now;
+                m_log->trace("Alarm {} moved from shelf", alarmKey.xpathIndex());
+            } else if (!alarm.shelf && shelf) {
+                const auto counted = Statistics::Contribution::of(alarm);
+                alarm.shelf = shelf;
+                countChange(counted, Statistics::Contribution::of(alarm));
+                shard.alarms.reindex(alarmKey);
+                m_alarmListLastChanged = now;
+                m_shelfListLastChanged = now;
+                m_log->trace("Alarm {} shelved ({})", alarmKey.xpathIndex(), *shelf);
+            } else {
+                alarm.shelf = shelf;
+                m_shelfListLastChanged = now;
+                m_log->trace("Alarm {} moved between shelfs ({} -> {})", alarmKey.xpathIndex(), *previousShelf, *shelf);
+            }
+            m_events.alarmReshelved(alarmKey, alarm, previousShelf);
+        });
+    }
+
+    return change;
+}
+
+/** @brief Must be called with m_configMtx and all shards locked */
+bool AlarmEngine::resizeStatusChangesLists()
+{
+    WITH_TIME_MEASUREMENT{};
+    bool changed = false;
+
+    m_log->debug("Resizing status changes history because max-alarm-status-changes changed to {}",
+                 m_settings.maxAlarmStatusChanges ? std::to_string(*m_settings.maxAlarmStatusChanges) : "infinite");
+
+    for (auto& shard : m_alarms) {
+        shard.alarms.forEach([&](const InstanceKey& alarmKey, AlarmEntry& alarm) {
+            alarm.statusChanges.setLimit(m_settings.maxAlarmStatusChanges, [&](const TimePoint& time) {
+                changed = true;
+                m_events.statusChangeRemoved(alarmKey, alarm, time);
+            });
+        });
+    }
+
+    return changed;
+}
+
+bool AlarmEngine::hasDampedAlarms()
+{
+    std::unique_lock lck{m_dampedMtx};
+    return !m_dampedAlarms.empty();
+}
+
+/** @short Pass on the held status changes of damped alarms at once, and release those alarms which have calmed down
+ *
+ * This is meant to be called once per FlapDamping::summaryInterval.
+ *
+ * @return the number of alarms which were passed on via Events::alarmUpdated()
+ * */
+unsigned AlarmEngine::summarizeDampedAlarms(const TimePoint now)
+{
+    std::vector<InstanceKey> damped;
+    {
+        std::unique_lock lck{m_dampedMtx};
+        damped.assign(m_dampedAlarms.begin(), m_dampedAlarms.end());
+    }
+
+    std::shared_lock cfg{m_configMtx};
+    unsigned updates = 0;
+    for (const auto& alarmKey : damped) {
+        updates += summarizeDampedAlarm(now, alarmKey);
+    }
+    if (updates) {
+        m_log->debug("Flap damping: {} summary updates", updates);
+    }
+    return updates;
+}
+
+/** @brief Must be called with m_configMtx held (shared is enough) */
+bool AlarmEngine::summarizeDampedAlarm(const TimePoint now, const InstanceKey& alarmKey)
+{
+    auto& shard = m_alarms.shardFor(alarmKey);
+    std::unique_lock shardLck{shard.mtx};
+
+    auto alarm = shard.alarms.find(alarmKey);
+    if (!alarm || !alarm->flapping.damped) {
+        // purged in the meantime
+        std::unique_lock lck{m_dampedMtx};
+        m_dampedAlarms.erase(alarmKey);
+        return false;
+    }
+
+    const bool released = alarm->flapping.release(*m_flapDamping, now);
+    const bool held = std::exchange(alarm->flapping.held, false);
+    if (!released && !held) {
+        return false;
+    }
+
+    AlarmChange change;
+    change.newStatusChange = held;
+    change.notify = held;
+    change.dampingStarted = false;
+    if (held) {
+        // all the held updates collapse into a single status change which carries the final state
+        change.removedStatusChange = alarm->statusChanges.push({alarm->lastChanged, alarm->isCleared ? ClearedSeverity : alarm->lastSeverity, alarm->text});
+        if (m_store) {
+            m_store->journalUpdate(alarmKey, *alarm, true);
+        }
+    }
+
+    if (released) {
+        m_log->info("Alarm {} is no longer flapping", alarmKey.xpathIndex());
+        std::unique_lock lck{m_dampedMtx};
+        m_dampedAlarms.erase(alarmKey);
+    }
+    m_events.alarmUpdated(alarmKey, *alarm, change);
+    shardLck.unlock();
+    checkStatistics();
+    return true;
+}
+
+/** @brief Hand the journaled changes over to the OS; call this before the changes are published */
+void AlarmEngine::flushJournal()
+{
+    if (m_store) {
+        m_store->flush();
+    }
+}
+
+/** @brief Take a new snapshot once the journal has grown too long. Must be called without any locks held. */
+void AlarmEngine::snapshotWhenDue()
+{
+    if (!m_store || !m_store->snapshotDue()) {
+        return;
+    }
+    std::shared_lock cfg{m_configMtx};
+    auto shards = m_alarms.lockAll();
+    // some other thread might have been faster
+    if (m_store->snapshotDue()) {
+        // the alarms are only needed until they are serialized, not while the snapshot is being written
+        snapshot([&] {
+            shards.clear();
+            cfg.unlock();
+        });
+    }
+}
+
+/** @brief Replace the persisted alarms by a new snapshot
+ *
+ * Must be called with all shards locked. The optional unlockAlarms() may release them once the alarms have been serialized.
+ * */
+void AlarmEngine::snapshot(const std::function<void()>& unlockAlarms)
+{
+    try {
+        m_store->snapshot(m_alarms, unlockAlarms);
+    } catch (std::exception& e) {
+        m_log->error("Cannot write a snapshot of the alarms: {}", e.what());
+    }
+}
+
+const std::optional<FlapDamping>& AlarmEngine::flapDamping() const
+{
+    return m_flapDamping;
+}
+
+/** @brief A consistent copy of the alarm counters */
+AlarmEngine::Statistics AlarmEngine::statistics() const
+{
+    std::unique_lock lck{m_statisticsMtx};
+    return m_statistics;
+}
+
+/** @brief Replace what an alarm used to contribute to the counters (if anything) by what it contributes now (if anything) */
+void AlarmEngine::countChange(const std::optional<Statistics::Contribution>& before, const std::optional<Statistics::Contribution>& after)
+{
+    std::unique_lock lck{m_statisticsMtx};
+    if (before) {
+        m_statistics.remove(*before);
+    }
+    if (after) {
+        m_statistics.add(*after);
+    }
+}
+
+TimePoint AlarmEngine::alarmListLastChanged() const
+{
+    return m_alarmListLastChanged.load();
+}
+
+TimePoint AlarmEngine::shelfListLastChanged() const
+{
+    return m_shelfListLastChanged.load();
+}
+
+AlarmEngine::Statistics::Contribution AlarmEngine::Statistics::Contribution::of(const AlarmEntry& alarm)
+{
+    return {.shelved = !!alarm.shelf, .severity = alarm.lastSeverity, .isCleared = alarm.isCleared};
+}
+
+void AlarmEngine::Statistics::add(const Contribution& alarm)
+{
+    if (alarm.shelved) {
+        // shelved alarms do not affect the alarm-summary
+        ++shelvedAlarms;
+        return;
+    }
+    ++alarms;
+    ++perSeverity[alarm.severity].total;
+    perSeverity[alarm.severity].cleared += alarm.isCleared;
+}
+
+void AlarmEngine::Statistics::remove(const Contribution& alarm)
+{
+    if (alarm.shelved) {
+        --shelvedAlarms;
+        return;
+    }
+    --alarms;
+    --perSeverity[alarm.severity].total;
+    perSeverity[alarm.severity].cleared -= alarm.isCleared;
+}
+
+/** @brief Check that the counters match a full recount of the alarms in debug builds. Must be called with all shards locked. */
+void AlarmEngine::verifyStatistics()
+{
+#ifndef NDEBUG
+    Statistics recounted;
+    for (auto& shard : m_alarms) {
+        shard.alarms.forEach([&](const InstanceKey&, const AlarmEntry& alarm) {
+            recounted.add(Statistics::Contribution::of(alarm));
+        });
+    }
+    assert(recounted == statistics());
+#endif
+}
+
+/** @brief verifyStatistics() for the callers which do not hold any shard; this does not lock anything in release builds */
+void AlarmEngine::checkStatistics()
+{
+#ifndef NDEBUG
+    auto shards = m_alarms.lockAll();
+    verifyStatistics();
+#endif
+}
+}
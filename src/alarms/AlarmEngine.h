@@ -0,0 +1,171 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <boost/unordered/unordered_flat_set.hpp>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include "AlarmEntry.h"
+#include "AlarmShards.h"
+#include "AlarmStore.h"
+#include "Filters.h"
+#include "FlapDamping.h"
+#include "Identities.h"
+#include "Key.h"
+#include "ShelfMatch.h"
+#include "utils/log-fwd.h"
+
+namespace alarms {
+
+/** @short A single alarm update, e.g., from the create-or-update-alarm RPC */
+struct AlarmInput {
+    InstanceKey key; /**< The identity should be resolved already, see AlarmEngine::findIdentity() */
+    int32_t severity;
+    std::string text;
+};
+
+/** @short The alarm list, the alarm summary, shelving, flap damping and persistence, without any transport
+ *
+ * The engine works on plain values only. Whoever drives it (e.g., the Daemon, or a benchmark) gets to know about
+ * changes of individual alarms through the Events interface. The events are delivered synchronously, while the
+ * affected alarm is still locked, so the events of a single alarm always arrive in order.
+ *
+ * All public functions are thread-safe. Lock ordering: m_configMtx, then the shards of m_alarms, then whatever the
+ * Events lock, then m_dampedMtx, m_statisticsMtx and the internal locks of m_store.
+ * */
+class AlarmEngine {
+public:
+    /** @short What has happened to an alarm which has changed */
+    struct AlarmChange {
+        bool newStatusChange; /**< The newest entry in AlarmEntry::statusChanges is a new one */
+        std::optional<TimePoint> removedStatusChange; /**< The oldest status change which was dropped to make room for the new one */
+        bool notify; /**< An alarm-notification should be sent */
+        bool dampingStarted; /**< The alarm is flapping, and its updates are going to be summarized from now on */
+    };
+
+    /** @short Receives changes of individual alarms. Called with the shard of that alarm locked; must not call back into the engine, and should not block. */
+    class Events {
+    public:
+        virtual ~Events() = default;
+        /** @short An alarm has been created or updated */
+        virtual void alarmUpdated(const InstanceKey& key, const AlarmEntry& alarm, const AlarmChange& change) = 0;
+        /** @short An alarm has been purged; the entry is still there, but it is going to be removed right away */
+        virtual void alarmRemoved(const InstanceKey& key, const AlarmEntry& alarm) = 0;
+        /** @short The oldest status-change entry of an alarm has been dropped, either by compressing, or by a lower max-alarm-status-changes */
+        virtual void statusChangeRemoved(const InstanceKey& key, const AlarmEntry& alarm, const TimePoint& time) = 0;
+        /** @short An alarm has been shelved, unshelved, or moved to another shelf */
+        virtual void alarmReshelved(const InstanceKey& key, const AlarmEntry& alarm, const std::optional<std::string>& previousShelf) = 0;
+    };
+
+    /** @short Settings from the /ietf-alarms:alarms/control container, except the shelving rules */
+    struct Settings {
+        NotifyStatusChanges notifyStatusChanges = NotifyStatusChanges::All;
+        std::optional<int32_t> notifySeverityThreshold;
+        std::optional<uint16_t> maxAlarmStatusChanges;
+    };
+
+    /** @short Alarm counters which are kept up-to-date as individual alarms change
+     *
+     * The counters are shared by all shards of m_alarms. Each change of an alarm is applied to them at once, so a copy
+     * which is taken via statistics() counts each alarm exactly once, even while other alarms are being updated.
+     * */
+    struct Statistics {
+        struct PerSeverity {
+            unsigned total = 0;
+            unsigned cleared = 0;
+
+            bool operator==(const PerSeverity& other) const = default;
+        };
+
+        /** @short The attributes of a single alarm which the counters depend on */
+        struct Contribution {
+            bool shelved;
+            int32_t severity;
+            bool isCleared;
+
+            static Contribution of(const AlarmEntry& alarm);
+        };
+
+        std::array<PerSeverity, 7> perSeverity{}; /**< Indexed by the severity value, only the shelved alarms are not included */
+        unsigned alarms = 0;
+        unsigned shelvedAlarms = 0;
+
+        void add(const Contribution& alarm);
+        void remove(const Contribution& alarm);
+        bool operator==(const Statistics& other) const = default;
+    };
+
+    AlarmEngine(Events& events, const std::optional<FlapDamping>& flapDamping = std::nullopt, const std::optional<std::filesystem::path>& stateDirectory = std::nullopt);
+    ~AlarmEngine();
+
+    std::optional<IdentityTable::Index> findIdentity(const std::string& alarmTypeId);
+    bool learnIdentities(const libyang::Context& ctx);
+    ShelvingRules compileShelvingRules(const libyang::Set<libyang::DataNode>& shelves);
+    Settings settings();
+    bool reconfigure(const Settings& settings, std::optional<ShelvingRules>&& shelvingRules);
+
+    void restore();
+    bool update(const TimePoint received, const AlarmInput& input);
+    unsigned purge(const AlarmFilter& filter, const bool shelved, const TimePoint now);
+    unsigned compress(const AlarmFilter& filter, const bool shelved);
+    bool hasDampedAlarms();
+    unsigned summarizeDampedAlarms(const TimePoint now);
+    void flushJournal();
+    void snapshotWhenDue();
+
+    const std::optional<FlapDamping>& flapDamping() const;
+    Statistics statistics() const;
+    TimePoint alarmListLastChanged() const;
+    TimePoint shelfListLastChanged() const;
+
+    /** @short Call fn(const AlarmEntry&) for a single alarm, if it exists, with its shard locked */
+    template <typename Fn>
+    bool visit(const InstanceKey& key, Fn&& fn)
+    {
+        auto& shard = m_alarms.shardFor(key);
+        std::unique_lock shardLck{shard.mtx};
+        if (auto alarm = shard.alarms.find(key)) {
+            fn(static_cast<const AlarmEntry&>(*alarm));
+            return true;
+        }
+        return false;
+    }
+
+    /** @short Call fn(const InstanceKey&, const AlarmEntry&) for each alarm, with one shard locked at a time */
+    template <typename Fn>
+    void forEach(Fn&& fn)
+    {
+        for (auto& shard : m_alarms) {
+            std::unique_lock shardLck{shard.mtx};
+            shard.alarms.forEach([&](const InstanceKey& key, const AlarmEntry& alarm) { fn(key, alarm); });
+        }
+    }
+
+private:
+    Events& m_events;
+    alarms::Log m_log;
+    std::shared_mutex m_configMtx; /**< Settings, identities and shelving rules; exclusive only when these change */
+    Settings m_settings;
+    IdentityTable m_identities;
+    ShelvingRules m_shelvingRules;
+    AlarmShards m_alarms;
+    mutable std::mutex m_statisticsMtx; /**< Protects m_statistics */
+    Statistics m_statistics;
+    std::atomic<TimePoint> m_alarmListLastChanged, m_shelfListLastChanged;
+    std::optional<FlapDamping> m_flapDamping;
+    std::mutex m_dampedMtx;
+    boost::unordered_flat_set<InstanceKey, boost::hash<InstanceKey>> m_dampedAlarms; /**< Protected by m_dampedMtx; can also contain alarms which were purged since */
+    std::optional<AlarmStore> m_store; /**< Only when the alarms are persisted */
+
+    bool summarizeDampedAlarm(const TimePoint now, const InstanceKey& alarmKey);
+    void countChange(const std::optional<Statistics::Contribution>& before, const std::optional<Statistics::Contribution>& after);
+    bool reshelve();
+    bool resizeStatusChangesLists();
+    void snapshot(const std::function<void()>& unlockAlarms = [] {});
+    void verifyStatistics();
+    void checkStatistics();
+};
+}
@@ -1,11 +1,14 @@
 #pragma once
 #include <chrono>
-#include <libyang-cpp/DataNode.hpp>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include "FlapDamping.h"
+#include "StatusChangeHistory.h"
 
 namespace alarms {
-using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
+
+constexpr int32_t ClearedSeverity = 1; // from the RFC
 
 enum class NotifyStatusChanges {
     All,
@@ -13,39 +16,32 @@ enum class NotifyStatusChanges {
     BySeverity,
 };
 
-struct StatusChange {
-    TimePoint time;
-    int32_t perceivedSeverity;
-    std::string text;
-};
-
 struct AlarmEntry {
     TimePoint created;
     TimePoint lastRaised;
     TimePoint lastChanged;
     std::string text;
     std::optional<std::string> shelf;
-    int32_t lastSeverity;
-    bool isCleared;
-    std::vector<StatusChange> statusChanges;
+    int32_t lastSeverity = 0;
+    bool isCleared = false;
+    StatusChangeHistory statusChanges;
+    FlapState flapping;
 
     struct WhatChanged {
         bool changed;
         bool shouldNotify;
-        std::vector<TimePoint> removedStatusChanges;
+        std::optional<TimePoint> removedStatusChange; /**< The oldest status change which was dropped to make room for the new one */
     };
 
-    std::vector<TimePoint> shrinkStatusChanges(const std::optional<uint16_t> maxAlarmStatusChanges);
-
-    WhatChanged updateByRpc(
+    WhatChanged update(
         const bool wasPresent,
         const TimePoint now,
-        const libyang::DataNode& input,
+        const int32_t severity,
+        const std::string& text,
         const std::optional<std::string> shelf,
         const NotifyStatusChanges notifyStatusChanges,
         const std::optional<int32_t> notifySeverityThreshold,
-        const std::optional<uint16_t> maxAlarmStatusChanges);
+        const std::optional<uint16_t> maxAlarmStatusChanges,
+        const bool held);
 };
-
-std::string statusChangeXPath(const std::string& alarmNodePath, const TimePoint& time);
 }
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include "AlarmShards.h"
+
+namespace {
+/** @short How many times it is cheaper to scan one slot of the columns than to visit one entry through an index */
+constexpr size_t ScanSpeedup = 8;
+
+/** @brief Call fn(handle) for each bit which is set */
+template <typename Fn>
+void forEachSetBit(const alarms::AlarmTable::Bitmask& bitmask, Fn&& fn)
+{
+    for (size_t block = 0; block < bitmask.size(); ++block) {
+        for (auto bits = bitmask[block]; bits; bits &= bits - 1) {
+            fn(static_cast<alarms::AlarmTable::Handle>(block * 64 + std::countr_zero(bits)));
+        }
+    }
+}
+
+/** @brief Remove a handle from a set of handles which belong to the same value, dropping the empty set */
+template <typename Index>
+void removeFrom(Index& index, const std::string& value, const alarms::AlarmTable::Handle handle)
+{
+    auto it = index.find(value);
+    it->second.erase(handle);
+    if (it->second.empty()) {
+        index.erase(it);
+    }
+}
+}
+
+namespace alarms {
+
+IndexedAttributes IndexedAttributes::of(const AlarmEntry& alarm)
+{
+    return {.lastChanged = alarm.lastChanged, .severity = alarm.lastSeverity, .isCleared = alarm.isCleared, .shelved = !!alarm.shelf};
+}
+
+bool AlarmQuery::matches(const InstanceKey& key, const IndexedAttributes& attributes) const
+{
+    return attributes.shelved == shelved
+        && (!isCleared || attributes.isCleared == *isCleared)
+        && attributes.severity >= minSeverity
+        && attributes.severity <= maxSeverity
+        && (!changedBefore || attributes.lastChanged < *changedBefore)
+        && (!resource || key.resource == *resource)
+        && (!typeId || key.type.id == *typeId);
+}
+
+AlarmEntry* AlarmTable::find(const InstanceKey& key)
+{
+    if (auto it = m_index.find(key); it != m_index.end()) {
+        return &m_slab[it->second].entry;
+    }
+    return nullptr;
+}
+
+/** @brief Find an alarm, or create a default-constructed entry for it
+ *
+ * @return the entry, and whether it has been just created
+ * */
+std::pair<AlarmEntry&, bool> AlarmTable::tryEmplace(const InstanceKey& key)
+{
+    if (auto it = m_index.find(key); it != m_index.end()) {
+        return {m_slab[it->second].entry, false};
+    }
+
+    Handle handle;
+    if (!m_freeSlots.empty()) {
+        handle = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        handle = m_slab.size();
+        m_slab.emplace_back();
+        m_columns.lastChanged.emplace_back();
+        m_columns.severity.emplace_back();
+        m_columns.flags.emplace_back();
+    }
+    m_index.emplace(key, handle);
+    m_slab[handle].key = key;
+    m_byResource[key.resource].insert(handle);
+    m_byTypeId[key.type.id].insert(handle);
+    addToIndexes(handle);
+    return {m_slab[handle].entry, true};
+}
+
+/** @brief Update the secondary indexes after the IndexedAttributes of an existing alarm have changed */
+void AlarmTable::reindex(const InstanceKey& key)
+{
+    const auto handle = m_index.at(key);
+    if (indexed(handle) == IndexedAttributes::of(m_slab[handle].entry)) {
+        return;
+    }
+    removeFromIndexes(handle);
+    addToIndexes(handle);
+}
+
+size_t AlarmTable::size() const
+{
+    return m_index.size();
+}
+
+/** @brief Find the alarms which match the query, using whichever index yields fewer entries to look at */
+std::vector<AlarmTable::Handle> AlarmTable::candidates(const AlarmQuery& query) const
+{
+    std::vector<const HandleSet*> sources;
+    size_t sourceSize = 0;
+    for (const auto& [partition, handles] : m_partitions) {
+        if (partition.shelved == query.shelved
+            && (!query.isCleared || partition.isCleared == *query.isCleared)
+            && partition.severity >= query.minSeverity
+            && partition.severity <= query.maxSeverity) {
+            sources.push_back(&handles);
+            sourceSize += handles.size();
+        }
+    }
+
+    auto narrowTo = [&](const auto& index, const std::optional<std::string>& value) {
+        if (!value) {
+            return;
+        }
+        if (auto it = index.find(*value); it == index.end()) {
+            sources.clear();
+            sourceSize = 0;
+        } else if (it->second.size() < sourceSize) {
+            sources = {&it->second};
+            sourceSize = it->second.size();
+        }
+    };
+    narrowTo(m_byResource, query.resource);
+    narrowTo(m_byTypeId, query.typeId);
+
+    std::vector<Handle> res;
+    if (!sourceSize) {
+        return res;
+    }
+
+    const auto scanInstead = m_slab.size() / ScanSpeedup;
+
+    if (query.changedBefore) {
+        // the time range is only worth it when it is shorter than the other options; stop walking it otherwise
+        const auto budget = std::min(sourceSize, scanInstead);
+        auto it = m_byLastChanged.begin();
+        for (size_t visited = 0; it != m_byLastChanged.end() && it->first < *query.changedBefore && visited < budget; ++it, ++visited) {
+            if (query.matches(m_slab[it->second].key, indexed(it->second))) {
+                res.push_back(it->second);
+            }
+        }
+        if (it == m_byLastChanged.end() || it->first >= *query.changedBefore) {
+            return res;
+        }
+        res.clear();
+    }
+
+    if (sourceSize > scanInstead) {
+        Bitmask matching;
+        scan(query, matching);
+        const bool checkKeys = query.resource || query.typeId;
+        forEachSetBit(matching, [&](const Handle handle) {
+            if (!checkKeys || query.matches(m_slab[handle].key, indexed(handle))) {
+                res.push_back(handle);
+            }
+        });
+        return res;
+    }
+
+    for (const auto* handles : sources) {
+        for (const auto handle : *handles) {
+            if (query.matches(m_slab[handle].key, indexed(handle))) {
+                res.push_back(handle);
+            }
+        }
+    }
+    return res;
+}
+
+/** @brief Evaluate the query over all slots, except for its resource and type ID
+ *
+ * This only touches the dense arrays of the IndexedAttributes, without any branches, so that the compiler can
+ * vectorize it.
+ * */
+void AlarmTable::scan(const AlarmQuery& query, Bitmask& matching) const
+{
+    const uint8_t flagsMask = Live | Shelved | (query.isCleared ? Cleared : 0);
+    const uint8_t flagsWanted = Live | (query.shelved ? Shelved : 0) | (query.isCleared.value_or(false) ? Cleared : 0);
+    const bool anyTime = !query.changedBefore;
+    const auto changedBefore = query.changedBefore.value_or(TimePoint{}).time_since_epoch().count();
+    const auto minSeverity = query.minSeverity;
+    const auto maxSeverity = query.maxSeverity;
+
+    const auto slots = m_columns.flags.size();
+    const auto* flags = m_columns.flags.data();
+    const auto* severity = m_columns.severity.data();
+    const auto* lastChanged = m_columns.lastChanged.data();
+
+    matching.assign((slots + 63) / 64, 0);
+    for (size_t block = 0; block < matching.size(); ++block) {
+        const auto begin = block * 64;
+        const auto end = std::min(begin + 64, slots);
+        uint64_t bits = 0;
+        for (auto i = begin; i < end; ++i) {
+            const bool match = ((flags[i] & flagsMask) == flagsWanted)
+                & (severity[i] >= minSeverity)
+                & (severity[i] <= maxSeverity)
+                & (anyTime | (lastChanged[i] < changedBefore));
+            bits |= uint64_t{match} << (i - begin);
+        }
+        matching[block] = bits;
+    }
+}
+
+/** @brief Count the alarms which match the query */
+size_t AlarmTable::count(const AlarmQuery& query) const
+{
+    Bitmask matching;
+    scan(query, matching);
+
+    size_t res = 0;
+    if (query.resource || query.typeId) {
+        forEachSetBit(matching, [&](const Handle handle) {
+            res += query.matches(m_slab[handle].key, indexed(handle));
+        });
+    } else {
+        for (const auto bits : matching) {
+            res += std::popcount(bits);
+        }
+    }
+    return res;
+}
+
+IndexedAttributes AlarmTable::indexed(const Handle handle) const
+{
+    return {
+        .lastChanged = TimePoint{TimePoint::duration{m_columns.lastChanged[handle]}},
+        .severity = m_columns.severity[handle],
+        .isCleared = !!(m_columns.flags[handle] & Cleared),
+        .shelved = !!(m_columns.flags[handle] & Shelved),
+    };
+}
+
+void AlarmTable::addToIndexes(const Handle handle)
+{
+    const auto attributes = IndexedAttributes::of(m_slab[handle].entry);
+    m_columns.lastChanged[handle] = attributes.lastChanged.time_since_epoch().count();
+    m_columns.severity[handle] = attributes.severity;
+    m_columns.flags[handle] = Live | (attributes.isCleared ? Cleared : 0) | (attributes.shelved ? Shelved : 0);
+    m_byLastChanged.emplace(attributes.lastChanged, handle);
+    m_partitions[{attributes.shelved, attributes.isCleared, attributes.severity}].insert(handle);
+}
+
+void AlarmTable::removeFromIndexes(const Handle handle)
+{
+    const auto attributes = indexed(handle);
+    m_byLastChanged.erase({attributes.lastChanged, handle});
+    auto partition = m_partitions.find({attributes.shelved, attributes.isCleared, attributes.severity});
+    partition->second.erase(handle);
+    if (partition->second.empty()) {
+        m_partitions.erase(partition);
+    }
+}
+
+void AlarmTable::release(const Handle handle)
+{
+    removeFromIndexes(handle);
+    removeFrom(m_byResource, m_slab[handle].key.resource, handle);
+    removeFrom(m_byTypeId, m_slab[handle].key.type.id, handle);
+    m_slab[handle] = Slot{};
+    m_columns.flags[handle] = 0;
+    m_freeSlots.push_back(handle);
+}
+
+AlarmShards::AlarmShards(const size_t count)
+    : m_shards(count)
+{
+    if (!count) {
+        throw std::invalid_argument{"AlarmShards: at least one shard is needed"};
+    }
+}
+
+AlarmShards::Shard& AlarmShards::shardFor(const InstanceKey& key)
+{
+    return m_shards[boost::hash<InstanceKey>{}(key) % m_shards.size()];
+}
+
+/** @brief Lock all shards, always in the same order */
+std::vector<std::unique_lock<std::mutex>> AlarmShards::lockAll()
+{
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(m_shards.size());
+    for (auto& shard : m_shards) {
+        locks.emplace_back(shard.mtx);
+    }
+    return locks;
+}
+
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include <boost/container_hash/hash.hpp>
+#include <boost/unordered/unordered_flat_map.hpp>
+#include <boost/unordered/unordered_flat_set.hpp>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "AlarmEntry.h"
+#include "Key.h"
+
+namespace alarms {
+
+/** @short Attributes of an alarm which have secondary indexes in the AlarmTable */
+struct IndexedAttributes {
+    TimePoint lastChanged;
+    int32_t severity;
+    bool isCleared;
+    bool shelved;
+
+    static IndexedAttributes of(const AlarmEntry& alarm);
+    bool operator==(const IndexedAttributes&) const = default;
+};
+
+/** @short Which alarms are interesting, in terms of their indexed attributes */
+struct AlarmQuery {
+    bool shelved = false;
+    std::optional<bool> isCleared; /**< Any clearance status when not set */
+    int32_t minSeverity = std::numeric_limits<int32_t>::min();
+    int32_t maxSeverity = std::numeric_limits<int32_t>::max();
+    std::optional<TimePoint> changedBefore;
+    std::optional<std::string> resource;
+    std::optional<std::string> typeId;
+
+    bool matches(const InstanceKey& key, const IndexedAttributes& attributes) const;
+};
+
+/** @short Alarm entries indexed by their key
+ *
+ * The index is a flat open-addressing hash table which only maps keys to small handles. The entries themselves live
+ * in a slab whose slots never move, so references to an entry remain valid until that entry is erased, even when other
+ * entries are added. Slots of erased entries are reused.
+ *
+ * There are also secondary indexes: all entries ordered by their lastChanged time, sets of entries partitioned by
+ * their shelved flag, clearance status and severity, and sets of entries by their resource and by their alarm type ID.
+ * These let forEach() and eraseIf() with an AlarmQuery visit only the candidate entries. The keys never change, but
+ * whenever any of the IndexedAttributes of an entry change, call reindex().
+ *
+ * The IndexedAttributes of all slots are also kept in dense parallel arrays. When a query would visit a large part of
+ * the table anyway, it is cheaper to evaluate it over these arrays in one go, see scan().
+ * */
+class AlarmTable {
+public:
+    using Handle = uint32_t;
+    using Bitmask = std::vector<uint64_t>; /**< One bit per slot */
+
+    AlarmEntry* find(const InstanceKey& key);
+    std::pair<AlarmEntry&, bool> tryEmplace(const InstanceKey& key);
+    void reindex(const InstanceKey& key);
+    size_t size() const;
+
+    /** @brief Call fn(key, entry) for each alarm */
+    template <typename Fn>
+    void forEach(Fn&& fn)
+    {
+        for (const auto& [key, handle] : m_index) {
+            fn(key, m_slab[handle].entry);
+        }
+    }
+
+    /** @brief Call fn(key, entry) for each alarm which matches the query */
+    template <typename Fn>
+    void forEach(const AlarmQuery& query, Fn&& fn)
+    {
+        for (const auto handle : candidates(query)) {
+            fn(std::as_const(m_slab[handle].key), m_slab[handle].entry);
+        }
+    }
+
+    /** @brief Remove all alarms for which pred(key, entry) returns true
+     *
+     * @return the number of removed alarms
+     * */
+    template <typename Pred>
+    size_t eraseIf(Pred&& pred)
+    {
+        size_t erased = 0;
+        for (auto it = m_index.begin(); it != m_index.end(); /* nothing */) {
+            if (pred(it->first, std::as_const(m_slab[it->second].entry))) {
+                release(it->second);
+                it = m_index.erase(it);
+                ++erased;
+            } else {
+                ++it;
+            }
+        }
+        return erased;
+    }
+
+    /** @brief Remove those alarms matching the query for which pred(key, entry) also returns true
+     *
+     * Only the alarms which match the query are passed to the predicate.
+     *
+     * @return the number of removed alarms
+     * */
+    template <typename Pred>
+    size_t eraseIf(const AlarmQuery& query, Pred&& pred)
+    {
+        size_t erased = 0;
+        for (const auto handle : candidates(query)) {
+            auto& slot = m_slab[handle];
+            if (pred(std::as_const(slot.key), std::as_const(slot.entry))) {
+                m_index.erase(slot.key);
+                release(handle);
+                ++erased;
+            }
+        }
+        return erased;
+    }
+
+    std::vector<Handle> candidates(const AlarmQuery& query) const;
+    void scan(const AlarmQuery& query, Bitmask& matching) const;
+    size_t count(const AlarmQuery& query) const;
+
+private:
+    using HandleSet = boost::unordered_flat_set<Handle>;
+
+    struct Slot {
+        InstanceKey key;
+        AlarmEntry entry;
+    };
+
+    enum Flags : uint8_t {
+        Live = 1,
+        Cleared = 2,
+        Shelved = 4,
+    };
+
+    /** @short The IndexedAttributes of each slot as of its last reindex(), indexed by the handle */
+    struct Columns {
+        std::vector<TimePoint::rep> lastChanged;
+        std::vector<int32_t> severity;
+        std::vector<uint8_t> flags; /**< Flags; a slot without Live is free */
+    };
+
+    /** @short Alarms with the same shelved flag, clearance status and severity */
+    struct Partition {
+        bool shelved;
+        bool isCleared;
+        int32_t severity;
+
+        bool operator==(const Partition&) const = default;
+        friend size_t hash_value(const Partition& partition)
+        {
+            size_t seed = 0;
+            boost::hash_combine(seed, partition.shelved);
+            boost::hash_combine(seed, partition.isCleared);
+            boost::hash_combine(seed, partition.severity);
+            return seed;
+        }
+    };
+
+    boost::unordered_flat_map<InstanceKey, Handle, boost::hash<InstanceKey>> m_index;
+    std::deque<Slot> m_slab;
+    std::vector<Handle> m_freeSlots;
+    Columns m_columns;
+    std::set<std::pair<TimePoint, Handle>> m_byLastChanged;
+    boost::unordered_flat_map<Partition, HandleSet, boost::hash<Partition>> m_partitions;
+    boost::unordered_flat_map<std::string, HandleSet, boost::hash<std::string>> m_byResource;
+    boost::unordered_flat_map<std::string, HandleSet, boost::hash<std::string>> m_byTypeId;
+
+    IndexedAttributes indexed(const Handle handle) const;
+    void addToIndexes(const Handle handle);
+    void removeFromIndexes(const Handle handle);
+    void release(const Handle handle);
+};
+
+/** @short Alarm entries partitioned by the hash of their key into shards which are locked independently
+ *
+ * Updates of alarms which live in different shards do not wait for each other. Whenever more than one shard
+ * has to be locked at once, use lockAll() which locks them in a fixed order.
+ * */
+class AlarmShards {
+public:
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        AlarmTable alarms;
+    };
+
+    explicit AlarmShards(const size_t count);
+
+    Shard& shardFor(const InstanceKey& key);
+    std::vector<std::unique_lock<std::mutex>> lockAll();
+
+    std::vector<Shard>::iterator begin() { return m_shards.begin(); }
+    std::vector<Shard>::iterator end() { return m_shards.end(); }
+
+private:
+    std::vector<Shard> m_shards;
+};
+
+}
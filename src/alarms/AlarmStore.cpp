@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include "AlarmStore.h"
+#include "utils/benchmark.h"
+#include "utils/log.h"
+
+using namespace std::string_literals;
+
+namespace {
+const auto snapshotFile = "alarms.snapshot";
+const auto journalFile = "alarms.journal";
+const auto newJournalFile = "alarms.journal.new";
+constexpr std::string_view snapshotMagic{"SRALSNAP"};
+constexpr std::string_view journalMagic{"SRALJRNL"};
+constexpr uint32_t formatVersion = 1;
+constexpr size_t headerSize = 8 + sizeof(uint32_t) + sizeof(uint64_t);
+constexpr size_t recordHeaderSize = 2 * sizeof(uint32_t);
+
+/** Do not bother with a new snapshot while the journal is shorter than this */
+constexpr size_t minJournalRecords = 10'000;
+
+enum class RecordType : uint8_t {
+    Alarm = 1, /**< Complete state of an alarm including all its status changes */
+    Update = 2, /**< State of an alarm, and at most one status change which is appended to the existing ones */
+    Removal = 3,
+};
+
+/** @short FNV-1a, which is good enough for telling a torn or corrupted record apart */
+uint32_t checksum(const std::string_view data)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char c : data) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/** @short Serialization in the native byte order; the files are never shared between machines */
+class Writer {
+public:
+    explicit Writer(std::string& out)
+        : m_out(out)
+    {
+    }
+
+    template <typename T>
+    void put(const T value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        m_out.append(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+
+    void putString(const std::string& value)
+    {
+        put(static_cast<uint32_t>(value.size()));
+        m_out.append(value);
+    }
+
+    void putTime(const alarms::TimePoint time)
+    {
+        put<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+    }
+
+private:
+    std::string& m_out;
+};
+
+/** @short Deserialization counterpart of the Writer which throws on truncated data */
+class Reader {
+public:
+    explicit Reader(const std::string_view data)
+        : m_data(data)
+    {
+    }
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        std::memcpy(&value, take(sizeof value).data(), sizeof value);
+        return value;
+    }
+
+    std::string getString()
+    {
+        return std::string{take(get<uint32_t>())};
+    }
+
+    alarms::TimePoint getTime()
+    {
+        return alarms::TimePoint{std::chrono::duration_cast<alarms::TimePoint::duration>(std::chrono::nanoseconds{get<int64_t>()})};
+    }
+
+    std::string_view take(const size_t size)
+    {
+        if (size > m_data.size()) {
+            throw std::runtime_error{"truncated data"};
+        }
+        auto res = m_data.substr(0, size);
+        m_data.remove_prefix(size);
+        return res;
+    }
+
+    size_t remaining() const
+    {
+        return m_data.size();
+    }
+
+private:
+    std::string_view m_data;
+};
+
+std::string fileHeader(const std::string_view magic, const uint64_t generation)
+{
+    std::string res{magic};
+    Writer w{res};
+    w.put(formatVersion);
+    w.put(generation);
+    return res;
+}
+
+/** @brief Generation of a snapshot or of a journal, if the file header is valid */
+std::optional<uint64_t> parseHeader(Reader& reader, const std::string_view magic)
+{
+    if (reader.remaining() < headerSize || reader.take(magic.size()) != magic || reader.get<uint32_t>() != formatVersion) {
+        return std::nullopt;
+    }
+    return reader.get<uint64_t>();
+}
+
+void appendRecord(std::string& out, const RecordType type, const alarms::InstanceKey& key, const alarms::AlarmEntry* alarm, const size_t firstStatusChange)
+{
+    const auto start = out.size();
+    out.append(recordHeaderSize, '\0');
+
+    Writer w{out};
+    w.put(type);
+    w.putString(key.resource);
+    w.putString(key.type.id);
+    w.putString(key.type.qualifier);
+    if (alarm) {
+        w.putTime(alarm->created);
+        w.putTime(alarm->lastRaised);
+        w.putTime(alarm->lastChanged);
+        w.putString(alarm->text);
+        w.put<uint8_t>(!!alarm->shelf);
+        if (alarm->shelf) {
+            w.putString(*alarm->shelf);
+        }
+        w.put(alarm->lastSeverity);
+        w.put<uint8_t>(alarm->isCleared);
+        w.put(static_cast<uint32_t>(alarm->statusChanges.size() - firstStatusChange));
+        for (auto i = firstStatusChange; i < alarm->statusChanges.size(); ++i) {
+            const auto& change = alarm->statusChanges[i];
+            w.putTime(change.time);
+            w.put(change.perceivedSeverity);
+            w.putString(change.text);
+        }
+    }
+
+    const auto payload = std::string_view{out}.substr(start + recordHeaderSize);
+    const uint32_t header[] = {static_cast<uint32_t>(payload.size()), checksum(payload)};
+    std::memcpy(out.data() + start, header, recordHeaderSize);
+}
+
+void applyRecord(Reader& reader, alarms::AlarmStore::Alarms& alarms)
+{
+    const auto type = reader.get<RecordType>();
+    alarms::InstanceKey key;
+    key.resource = reader.getString();
+    key.type.id = reader.getString();
+    key.type.qualifier = reader.getString();
+
+    switch (type) {
+    case RecordType::Removal:
+        alarms.erase(key);
+        return;
+    case RecordType::Alarm:
+        alarms.erase(key);
+        break;
+    case RecordType::Update:
+        break;
+    default:
+        throw std::runtime_error{"unknown record type"};
+    }
+
+    auto& alarm = alarms[key];
+    alarm.created = reader.getTime();
+    alarm.lastRaised = reader.getTime();
+    alarm.lastChanged = reader.getTime();
+    alarm.text = reader.getString();
+    if (reader.get<uint8_t>()) {
+        alarm.shelf = reader.getString();
+    } else {
+        alarm.shelf = std::nullopt;
+    }
+    alarm.lastSeverity = reader.get<int32_t>();
+    alarm.isCleared = reader.get<uint8_t>();
+    for (auto count = reader.get<uint32_t>(); count > 0; --count) {
+        alarms::StatusChange change;
+        change.time = reader.getTime();
+        change.perceivedSeverity = reader.get<int32_t>();
+        change.text = reader.getString();
+        alarm.statusChanges.push(std::move(change));
+    }
+}
+
+/** @brief Apply all valid records
+ *
+ * @return the number of records and the number of bytes which were applied, i.e., where the valid data end
+ * */
+std::pair<size_t, size_t> replay(Reader& reader, alarms::AlarmStore::Alarms& alarms, const alarms::Log& log, const std::string& what)
+{
+    const auto total = reader.remaining();
+    size_t records = 0;
+    size_t valid = 0;
+    while (reader.remaining()) {
+        if (reader.remaining() < recordHeaderSize) {
+            log->warn("Ignoring a torn record at the end of the {}", what);
+            break;
+        }
+        const auto size = reader.get<uint32_t>();
+        const auto expectedChecksum = reader.get<uint32_t>();
+        if (size > reader.remaining()) {
+            log->warn("Ignoring a torn record at the end of the {}", what);
+            break;
+        }
+        const auto payload = reader.take(size);
+        try {
+            if (checksum(payload) != expectedChecksum) {
+                throw std::runtime_error{"checksum mismatch"};
+            }
+            Reader record{payload};
+            applyRecord(record, alarms);
+        } catch (std::runtime_error& e) {
+            log->error("Ignoring the rest of the {}: corrupted record ({})", what, e.what());
+            break;
+        }
+        ++records;
+        valid = total - reader.remaining();
+    }
+    return {records, valid};
+}
+
+std::optional<std::string> readFile(const std::filesystem::path& path)
+{
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (!file) {
+        return std::nullopt;
+    }
+    std::string data(file.tellg(), '\0');
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    return data;
+}
+
+/** @brief Write a file and make sure that it is on the disk before returning */
+void writeFileDurably(const std::filesystem::path& path, const std::string_view data)
+{
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        throw std::system_error{errno, std::system_category(), "Cannot create " + path.string()};
+    }
+    for (auto remaining = data; !remaining.empty();) {
+        auto written = ::write(fd, remaining.data(), remaining.size());
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error{err, std::system_category(), "Cannot write " + path.string()};
+        }
+        remaining.remove_prefix(written);
+    }
+    if (::fsync(fd) == -1) {
+        auto err = errno;
+        ::close(fd);
+        throw std::system_error{err, std::system_category(), "Cannot sync " + path.string()};
+    }
+    ::close(fd);
+}
+
+/** @brief Make a rename within a directory durable */
+void syncDirectory(const std::filesystem::path& path)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+}
+
+namespace alarms {
+
+AlarmStore::AlarmStore(const std::filesystem::path& directory)
+    : m_log(spdlog::get("main"))
+    , m_directory(directory)
+    , m_journalFailed(false)
+    , m_generation(0)
+    , m_journalRecords(0)
+    , m_snapshotRecords(0)
+    , m_pendingRecordCount(0)
+{
+    std::filesystem::create_directories(m_directory);
+}
+
+/** @brief Load the latest snapshot and replay the journal on top of it
+ *
+ * Afterwards, the journal is ready for appending new records.
+ * */
+AlarmStore::Alarms AlarmStore::load()
+{
+    WITH_TIME_MEASUREMENT{};
+    std::unique_lock lck{m_mtx};
+    Alarms alarms;
+
+    if (auto data = readFile(m_directory / snapshotFile)) {
+        Reader reader{*data};
+        if (auto generation = parseHeader(reader, snapshotMagic)) {
+            m_generation = *generation;
+            m_snapshotRecords = replay(reader, alarms, m_log, "alarm snapshot"s).first;
+        } else {
+            m_log->error("Ignoring {}: not a valid alarm snapshot", (m_directory / snapshotFile).string());
+        }
+    }
+
+    auto replayJournal = [&](const std::filesystem::path& path) {
+        auto data = readFile(path);
+        if (!data) {
+            return false;
+        }
+        Reader reader{*data};
+        if (parseHeader(reader, journalMagic) != m_generation) {
+            return false;
+        }
+        const auto [records, size] = replay(reader, alarms, m_log, "alarm journal"s);
+        m_journalRecords = records;
+        // drop what could not be replayed, so that the new records follow the valid ones
+        std::filesystem::resize_file(path, headerSize + size);
+        return true;
+    };
+
+    const auto journalPath = m_directory / journalFile;
+    const auto newJournalPath = m_directory / newJournalFile;
+    if (replayJournal(journalPath)) {
+        m_journal.open(journalPath, std::ios::binary | std::ios::app);
+    } else if (replayJournal(newJournalPath)) {
+        // the previous run has stopped between replacing the snapshot and replacing the journal
+        std::filesystem::rename(newJournalPath, journalPath);
+        m_journal.open(journalPath, std::ios::binary | std::ios::app);
+    } else if (std::filesystem::exists(journalPath)) {
+        m_log->warn("Ignoring {}: it does not belong to the current alarm snapshot", journalPath.string());
+    }
+    if (!m_journal.is_open()) {
+        startJournal(m_generation);
+    }
+
+    m_log->info("Loaded {} alarms ({} snapshot records, {} journal records)", alarms.size(), m_snapshotRecords, m_journalRecords);
+    return alarms;
+}
+
+/** @brief Record a changed alarm, along with its newest status change if that one is new */
+void AlarmStore::journalUpdate(const InstanceKey& key, const AlarmEntry& alarm, const bool newStatusChange)
+{
+    std::string record;
+    appendRecord(record, RecordType::Update, key, &alarm, newStatusChange && alarm.statusChanges.size() ? alarm.statusChanges.size() - 1 : alarm.statusChanges.size());
+    append(record);
+}
+
+/** @brief Record the complete state of an alarm, which is needed when some of its status changes were dropped */
+void AlarmStore::journalAlarm(const InstanceKey& key, const AlarmEntry& alarm)
+{
+    std::string record;
+    appendRecord(record, RecordType::Alarm, key, &alarm, 0);
+    append(record);
+}
+
+void AlarmStore::journalRemoval(const InstanceKey& key)
+{
+    std::string record;
+    appendRecord(record, RecordType::Removal, key, nullptr, 0);
+    append(record);
+}
+
+void AlarmStore::append(const std::string& record)
+{
+    std::unique_lock lck{m_mtx};
+    m_journal.write(record.data(), record.size());
+    ++m_journalRecords;
+    if (m_pendingRecords) {
+        m_pendingRecords->append(record);
+        ++m_pendingRecordCount;
+    }
+}
+
+/** @brief Hand the journal over to the OS */
+void AlarmStore::flush()
+{
+    std::unique_lock lck{m_mtx};
+    m_journal.flush();
+    if (!m_journal && !m_journalFailed) {
+        m_journalFailed = true;
+        m_log->error("Cannot write the alarm journal in {}, alarm updates will not survive a restart", m_directory.string());
+    }
+}
+
+/** @brief Is the journal long enough for a new snapshot to pay off? */
+bool AlarmStore::snapshotDue() const
+{
+    std::unique_lock lck{m_mtx};
+    return !m_pendingRecords && m_journalRecords > std::max(m_snapshotRecords, minJournalRecords);
+}
+
+/** @brief Replace the snapshot and the journal by a new snapshot
+ *
+ * All shards of the alarms must be locked by the caller. Once they have been serialized, unlockAlarms() is called, so
+ * that the caller can release them before the snapshot is written and synced to the disk.
+ * */
+void AlarmStore::snapshot(AlarmShards& alarms, const std::function<void()>& unlockAlarms)
+{
+    WITH_TIME_MEASUREMENT{};
+    std::unique_lock snapshotLck{m_snapshotMtx};
+    std::unique_lock lck{m_mtx};
+    const auto generation = m_generation + 1;
+
+    auto data = fileHeader(snapshotMagic, generation);
+    size_t records = 0;
+    for (auto& shard : alarms) {
+        shard.alarms.forEach([&](const InstanceKey& key, const AlarmEntry& alarm) {
+            appendRecord(data, RecordType::Alarm, key, &alarm, 0);
+            ++records;
+        });
+    }
+    m_pendingRecords.emplace();
+    m_pendingRecordCount = 0;
+    lck.unlock();
+    unlockAlarms();
+
+    const auto tmp = m_directory / (snapshotFile + ".tmp"s);
+    const auto newJournalPath = m_directory / newJournalFile;
+    try {
+        writeFileDurably(tmp, data);
+
+        lck.lock();
+        std::ofstream journal{newJournalPath, std::ios::binary | std::ios::trunc};
+        const auto header = fileHeader(journalMagic, generation);
+        journal.write(header.data(), header.size());
+        journal.write(m_pendingRecords->data(), m_pendingRecords->size());
+        journal.flush();
+        if (!journal) {
+            throw std::runtime_error{"Cannot write " + newJournalPath.string()};
+        }
+        std::filesystem::rename(tmp, m_directory / snapshotFile);
+
+        // from now on, the old journal is ignored, and load() falls back to the new one until it replaces the old one
+        m_generation = generation;
+        m_snapshotRecords = records;
+        m_journal = std::move(journal);
+        m_journalRecords = m_pendingRecordCount;
+        m_journalFailed = false;
+        m_pendingRecords.reset();
+    } catch (...) {
+        if (!lck.owns_lock()) {
+            lck.lock();
+        }
+        m_pendingRecords.reset();
+        throw;
+    }
+    lck.unlock();
+
+    std::error_code ec;
+    std::filesystem::rename(newJournalPath, m_directory / journalFile, ec);
+    if (ec) {
+        m_log->error("Cannot replace the alarm journal in {}: {}", m_directory.string(), ec.message());
+    }
+    syncDirectory(m_directory);
+    m_log->debug("Alarm snapshot with {} alarms", records);
+}
+
+/** @brief Replace the journal by an empty one. Must be called with m_mtx locked. */
+void AlarmStore::startJournal(const uint64_t generation)
+{
+    m_journal.close();
+    m_journal.clear();
+    m_journal.open(m_directory / journalFile, std::ios::binary | std::ios::trunc);
+    const auto header = fileHeader(journalMagic, generation);
+    m_journal.write(header.data(), header.size());
+    m_journal.flush();
+    m_journalRecords = 0;
+    m_journalFailed = false;
+}
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <boost/unordered/unordered_flat_map.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include "AlarmEntry.h"
+#include "AlarmShards.h"
+#include "Key.h"
+#include "utils/log-fwd.h"
+
+namespace alarms {
+
+/** @short Persistent copy of all alarms, so that they survive a restart of the daemon
+ *
+ * The directory holds a binary snapshot of all alarms, and an append-only journal of the changes since that snapshot.
+ * Both files are a sequence of checksummed records. A journal record carries the current state of a single alarm
+ * along with its new status-change entry, if any, so each alarm update only appends a small record. Once the journal
+ * has grown longer than the snapshot, it is time for a new snapshot which replaces both files.
+ *
+ * The journal is handed over to the OS on each flush(), so it survives a crash of the daemon. Only the snapshots are
+ * synced to the disk. A torn record at the end of the journal is ignored.
+ *
+ * A snapshot only needs the alarms for serializing them, the disk I/O happens after the caller has unlocked them. The
+ * changes which are journaled in the meantime still go to the old journal, and they also become the first records of the
+ * new one. The new journal is written aside and it replaces the old one right after the new snapshot is in place.
+ *
+ * All functions are thread-safe. The internal lock is the innermost one, it is never held while calling out.
+ * */
+class AlarmStore {
+public:
+    using Alarms = boost::unordered_flat_map<InstanceKey, AlarmEntry, boost::hash<InstanceKey>>;
+
+    explicit AlarmStore(const std::filesystem::path& directory);
+
+    Alarms load();
+    void journalUpdate(const InstanceKey& key, const AlarmEntry& alarm, const bool newStatusChange);
+    void journalAlarm(const InstanceKey& key, const AlarmEntry& alarm);
+    void journalRemoval(const InstanceKey& key);
+    void flush();
+    bool snapshotDue() const;
+    void snapshot(AlarmShards& alarms, const std::function<void()>& unlockAlarms = [] {});
+
+private:
+    alarms::Log m_log;
+    std::filesystem::path m_directory;
+    std::mutex m_snapshotMtx; /**< Only one snapshot is written at a time */
+    mutable std::mutex m_mtx;
+    std::ofstream m_journal;
+    bool m_journalFailed;
+    uint64_t m_generation; /**< Of the current snapshot; the journal is only valid along with the snapshot of the same generation */
+    size_t m_journalRecords;
+    size_t m_snapshotRecords;
+    std::optional<std::string> m_pendingRecords; /**< Journaled while a snapshot is being written, for the new journal */
+    size_t m_pendingRecordCount;
+
+    void append(const std::string& record);
+    void startJournal(const uint64_t generation);
+};
+}
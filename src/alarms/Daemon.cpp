@@ -1,9 +1,13 @@
+#include <algorithm>
+#include <array>
 #include <boost/algorithm/string/predicate.hpp>
+#include <cctype>
 #include <chrono>
-#include <libyang-cpp/Time.hpp>
+#include <iterator>
 #include <map>
 #include <span>
 #include <string>
+#include <utility>
 #include "Daemon.h"
 #include "Filters.h"
 #include "Key.h"
@@ -18,6 +22,7 @@ using namespace std::string_literals;
 namespace {
 const auto rootPath = "/ietf-alarms:alarms"s;
 const auto rpcPrefix = "/sysrepo-ietf-alarms:create-or-update-alarm";
+const auto batchRpcPrefix = "/sysrepo-ietf-alarms:create-or-update-alarms"s;
 const auto ietfAlarmsModule = "ietf-alarms";
 const auto alarmList = "/ietf-alarms:alarms/alarm-list"s;
 const auto alarmListInstances = "/ietf-alarms:alarms/alarm-list/alarm";
@@ -33,9 +38,11 @@ const auto ctrlNotifyStatusChanges = controlPrefix + "/notify-status-changes"s;
 const auto ctrlNotifySeverityLevel = controlPrefix + "/notify-severity-level"s;
 const auto ctrlShelving = controlPrefix + "/alarm-shelving"s;
 const auto ctrlMaxAlarmStatusChanges = controlPrefix + "/max-alarm-status-changes"s;
-const auto alarmSummaryPrefix = "/ietf-alarms:alarms/summary";
+const auto alarmSummaryPrefix = "/ietf-alarms:alarms/summary"s;
+const auto flappingLeaf = "sysrepo-ietf-alarms:flapping";
 
-const int32_t ClearedSeverity = 1; // from the RFC
+const auto notificationQueueCapacity = 10'000;
+const auto pendingSlices = 16;
 
 const std::array Severities{
     "_", // just a dummy on index 0
@@ -47,15 +54,142 @@ const std::array Severities{
     "critical",
 };
 
-/* @brief Checks if the alarm keys match any entry in ietf-alarms:alarms/control/alarm-shelving. If so, return name of the matched shelf */
-std::optional<std::string> shouldBeShelved(const libyang::DataNode& shelvingRules, const alarms::InstanceKey& key)
+/** @brief Find a node which has no list instances on its path, creating it if needed */
+libyang::DataNode findOrCreate(libyang::DataNode& tree, const std::string& path)
 {
-    return findMatchingShelf(key, shelvingRules.findXPath(ctrlShelving + "/shelf"));
+    if (auto node = tree.findPath(path)) {
+        return *node;
+    }
+    return *tree.newPath2(path).createdNode;
+}
+
+/** @brief Create an alarm node with just its keys, either in the alarm-list or in the shelved-alarms list
+ *
+ * The node is created from the key values and not from its path, so there are no restrictions on quoting.
+ * */
+libyang::DataNode newAlarmNode(libyang::DataNode& tree, const alarms::InstanceKey& key, const bool shelved)
+{
+    auto list = findOrCreate(tree, shelved ? shelvedAlarmList : alarmList);
+    return alarms::utils::newListInstance(list, shelved ? "shelved-alarm" : "alarm", {key.resource, key.type.id, key.type.qualifier});
+}
+
+/** @brief Create all leaves of a new alarm node except its keys and the status-change list */
+void renderAlarmLeaves(libyang::DataNode& alarmNode, const alarms::AlarmEntry& alarm, const alarms::utils::YangTimeFormatter& yangTimeFormat)
+{
+    alarmNode.newPath("is-cleared", alarm.isCleared ? "true" : "false");
+    alarmNode.newPath("last-raised", yangTimeFormat(alarm.lastRaised));
+    alarmNode.newPath("last-changed", yangTimeFormat(alarm.lastChanged));
+    alarmNode.newPath("perceived-severity", Severities[alarm.lastSeverity]);
+    alarmNode.newPath("alarm-text", alarm.text);
+    if (alarm.flapping.damped) {
+        alarmNode.newPath(flappingLeaf);
+    }
+    if (alarm.shelf) {
+        alarmNode.newPath("shelf-name", *alarm.shelf);
+    } else {
+        alarmNode.newPath("time-created", yangTimeFormat(alarm.created));
+    }
+}
+
+/** @brief Copy of an alarm without its status-change history, which is all that's needed for rendering its update */
+alarms::AlarmEntry withoutHistory(const alarms::AlarmEntry& alarm)
+{
+    alarms::AlarmEntry res;
+    res.created = alarm.created;
+    res.lastRaised = alarm.lastRaised;
+    res.lastChanged = alarm.lastChanged;
+    res.text = alarm.text;
+    res.shelf = alarm.shelf;
+    res.lastSeverity = alarm.lastSeverity;
+    res.isCleared = alarm.isCleared;
+    res.flapping = alarm.flapping;
+    return res;
+}
+
+/** @brief Append a status-change entry to an alarm node */
+libyang::DataNode newStatusChangeNode(libyang::DataNode& alarmNode, const alarms::TimePoint& time, const int32_t severity, const std::string& text, const alarms::utils::YangTimeFormatter& yangTimeFormat)
+{
+    auto node = alarms::utils::newListInstance(alarmNode, "status-change", {yangTimeFormat(time)});
+    node.newPath("perceived-severity", Severities[severity]);
+    node.newPath("alarm-text", text);
+    return node;
+}
+
+/** @brief Create a complete alarm node including its status-change history, with the latest change first */
+void renderAlarm(libyang::DataNode& tree, const alarms::InstanceKey& key, const alarms::AlarmEntry& alarm, const alarms::utils::YangTimeFormatter& yangTimeFormat)
+{
+    auto alarmNode = newAlarmNode(tree, key, !!alarm.shelf);
+    renderAlarmLeaves(alarmNode, alarm, yangTimeFormat);
+    for (auto i = alarm.statusChanges.size(); i-- > 0;) {
+        const auto& change = alarm.statusChanges[i];
+        newStatusChangeNode(alarmNode, change.time, change.perceivedSeverity, change.text, yangTimeFormat);
+    }
+}
+
+/** @short Find out which alarm instances are asked for by an operational data request
+ *
+ * Returns std::nullopt when the request does not need any alarm instances at all, e.g., when it only asks for the
+ * number-of-alarms leaf. Otherwise, the result contains values of those list keys which were specified in the request.
+ * This is just an optimization; sysrepo filters the provided data according to the request XPath anyway, so whenever
+ * the request is too complex, all instances are asked for.
+ * */
+std::optional<std::map<std::string, std::string>> requestedAlarmKeys(const std::optional<std::string_view>& requestXPath, const std::string_view listInstances)
+{
+    const auto everything = std::optional{std::map<std::string, std::string>{}};
+    if (!requestXPath) {
+        return everything;
+    }
+    const auto request = *requestXPath;
+    const auto listContainer = listInstances.substr(0, listInstances.rfind('/'));
+
+    if (!request.starts_with(listInstances)) {
+        if (!request.starts_with(std::string{listContainer} + '/')) {
+            // an ancestor of the list, or something which we do not understand
+            return everything;
+        }
+        const auto child = request.substr(listContainer.size() + 1);
+        if (std::all_of(child.begin(), child.end(), [](const unsigned char c) { return std::isalnum(c) || c == '-' || c == '_' || c == ':'; })) {
+            // another child of the list container, i.e., a leaf which doesn't depend on the alarm instances
+            return std::nullopt;
+        }
+        // wildcards, predicates, etc.
+        return everything;
+    }
+
+    std::map<std::string, std::string> keys;
+    auto predicates = request.substr(listInstances.size());
+    while (predicates.starts_with('[')) {
+        const auto eq = predicates.find('=');
+        if (eq == std::string_view::npos || eq + 1 >= predicates.size() || (predicates[eq + 1] != '\'' && predicates[eq + 1] != '"')) {
+            return everything;
+        }
+        const auto closingQuote = predicates.find(predicates[eq + 1], eq + 2);
+        if (closingQuote == std::string_view::npos || closingQuote + 1 >= predicates.size() || predicates[closingQuote + 1] != ']') {
+            return everything;
+        }
+        keys.emplace(predicates.substr(1, eq - 1), predicates.substr(eq + 2, closingQuote - eq - 2));
+        predicates.remove_prefix(closingQuote + 2);
+    }
+    return keys;
 }
 
-std::string yangTimeFormat(const std::chrono::time_point<std::chrono::system_clock>& timePoint)
+/** @brief The internal RPCs are meant for the local apps only, not for the NETCONF/RESTCONF clients */
+bool isExternalOriginator(const sysrepo::Session& session)
 {
-    return libyang::yangTimeFormat(timePoint, libyang::TimezoneInterpretation::Local);
+    return session.getOriginatorName() == "netopeer2"
+        || session.getOriginatorName() == "rousette"
+        || session.getOriginatorName() == "sysrepo-cli";
+}
+
+sysrepo::ErrorCode rejectExternalOriginator(sysrepo::Session session)
+{
+    session.setNetconfError({.type = "application",
+                             .tag = "operation-not-supported",
+                             .appTag = std::nullopt,
+                             .path = std::nullopt,
+                             .message = "Internal RPCs cannot be called.",
+                             .infoElements = {}});
+    return sysrepo::ErrorCode::OperationFailed;
 }
 }
 
@@ -63,74 +197,156 @@ namespace alarms {
 
 Daemon::~Daemon()
 {
+    // no more callbacks; they could otherwise queue notifications while the dispatcher is going away
+    m_operSub.reset();
+    m_controlSub.reset();
+    m_maintenanceSub.reset();
+    m_batchSub.reset();
+    m_alarmSub.reset();
+    m_inventorySub.reset();
+
+    // summaries get published via the write-behind, so this one has to stop first
+    if (m_summarizer.joinable()) {
+        {
+            std::unique_lock lck{m_summaryMtx};
+            m_stopSummaries = true;
+        }
+        m_summaryRequested.notify_all();
+        m_summarizer.join();
+    }
+
+    if (m_flusher.joinable()) {
+        {
+            std::unique_lock lck{m_mtx};
+            m_stopFlushing = true;
+        }
+        m_flushRequested.notify_all();
+        m_flusher.join();
+    }
+
+    if (m_inventoryRebuilder.joinable()) {
+        {
+            std::unique_lock lck{m_inventoryMtx};
+            m_stopInventoryRebuilds = true;
+        }
+        m_inventoryRebuildNeeded.notify_all();
+        m_inventoryRebuilder.join();
+    }
+
     std::unique_lock lck{m_mtx};
+    m_alarmNodes.clear();
     m_edit = std::nullopt;
 }
 
-Daemon::Daemon()
+Daemon::Daemon(const std::optional<WriteBehind>& writeBehind, const Publishing publishing, const utils::TimeZone timeZone, const std::optional<FlapDamping>& flapDamping, const std::optional<std::filesystem::path>& stateDirectory)
     : m_connection(sysrepo::Connection{})
     , m_session(m_connection.sessionStart(sysrepo::Datastore::Operational))
+    , m_notificationSession(m_connection.sessionStart(sysrepo::Datastore::Operational))
     , m_log(spdlog::get("main"))
-    , m_notifyStatusChanges(NotifyStatusChanges::All)
-    , m_inventoryDirty(true)
-    , m_alarmListLastChanged(TimePoint::clock::now())
-    , m_shelfListLastChanged(TimePoint::clock::now())
+    , m_timeFormatter(timeZone)
+    , m_pending(pendingSlices)
+    , m_notificationSequence(0)
+    , m_inventory(std::make_shared<const Inventory>())
+    , m_inventoryRebuildRequested(false)
+    , m_inventoryRebuildRunning(false)
+    , m_stopInventoryRebuilds(false)
+    , m_engine(*this, flapDamping, stateDirectory)
+    , m_writeBehind(writeBehind)
+    , m_pendingUpdates(0)
+    , m_stopFlushing(false)
+    , m_stopSummaries(false)
+    , m_notifications([this](const StatusChangeNotification& data) { m_notificationSession.sendNotification(createStatusChangeNotification(data), sysrepo::Wait::No); }, notificationQueueCapacity)
 {
     utils::ensureModuleImplemented(m_session, ietfAlarmsModule, "2019-09-11", {"alarm-shelving", "alarm-summary", "alarm-history"});
-    utils::ensureModuleImplemented(m_session, "sysrepo-ietf-alarms", "2022-02-17");
-
+    utils::ensureModuleImplemented(m_session, "sysrepo-ietf-alarms", "2026-10-17");
+    m_engine.learnIdentities(m_session.getContext());
+    m_engine.restore();
     {
+        // the shelves might have changed while the daemon was not running, and the restored alarms have to follow them
+        utils::ScopedDatastoreSwitch sw(m_session, sysrepo::Datastore::Running);
+        auto config = m_session.getData(ctrlShelving);
+        m_engine.reconfigure(m_engine.settings(), config ? m_engine.compileShelvingRules(config->findXPath(ctrlShelving + "/shelf")) : ShelvingRules{});
+    }
+
+    if (publishing == Publishing::Push) {
         WITH_TIME_MEASUREMENT{"initializing stats"};
         m_edit = m_session.getContext().newPath(alarmList, std::nullopt, libyang::CreationOptions::Update);
+        // the restored alarms are published in one go, before any RPC can arrive
+        m_engine.forEach([&](const InstanceKey& alarmKey, const AlarmEntry& alarm) {
+            auto& nodes = alarmNodes(alarmKey, alarm);
+            for (auto i = alarm.statusChanges.size(); i-- > 0;) {
+                const auto& change = alarm.statusChanges[i];
+                nodes.statusChanges.push_front(newStatusChangeNode(nodes.alarm, change.time, change.perceivedSeverity, change.text, m_timeFormatter));
+            }
+        });
         updateStatistics();
         m_session.editBatch(*m_edit, sysrepo::DefaultOperation::Replace);
         m_session.applyChanges();
+        m_unpublished = {};
+    } else if (m_writeBehind) {
+        m_log->warn("Write-behind has no effect when publishing alarms on demand");
+        m_writeBehind = std::nullopt;
     }
 
+    // the inventory has to be known before the first alarm arrives
+    m_inventorySub = m_session.onModuleChange(
+        ietfAlarmsModule, [&](sysrepo::Session session, auto, auto, auto, const sysrepo::Event event, auto) {
+            WITH_TIME_MEASUREMENT{alarmInventoryPrefix};
+            inventoryChanged(session, event);
+            m_session.sendNotification(m_session.getContext().newPath("/ietf-alarms:alarm-inventory-changed", std::nullopt), sysrepo::Wait::No);
+            return sysrepo::ErrorCode::Ok;
+        },
+        alarmInventoryPrefix,
+        0,
+        sysrepo::SubscribeOptions::Enabled | sysrepo::SubscribeOptions::DoneOnly);
+
     m_alarmSub = m_session.onRPCAction(rpcPrefix, [&](sysrepo::Session session, auto, auto, const libyang::DataNode input, auto, auto, auto) {
-        if (session.getOriginatorName() == "netopeer2"
-                || session.getOriginatorName() == "rousette"
-                || session.getOriginatorName() == "sysrepo-cli") {
-            session.setNetconfError({.type = "application",
-                                     .tag = "operation-not-supported",
-                                     .appTag = std::nullopt,
-                                     .path = std::nullopt,
-                                     .message = "Internal RPCs cannot be called.",
-                                     .infoElements = {}});
-            return sysrepo::ErrorCode::OperationFailed;
+        if (isExternalOriginator(session)) {
+            return rejectExternalOriginator(session);
         }
         return submitAlarm(session, input);
     });
-    m_alarmSub->onRPCAction(purgeRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return purgeAlarms(purgeRpcPrefix, input, output); });
-    m_alarmSub->onRPCAction(purgeShelvedRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return purgeAlarms(purgeShelvedRpcPrefix, input, output); });
-    m_alarmSub->onRPCAction(compressAlarmsRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return compressAlarms(compressAlarmsRpcPrefix, input, output); });
-    m_alarmSub->onRPCAction(compressShelvedAlarmsRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return compressAlarms(compressShelvedAlarmsRpcPrefix, input, output); });
+    // each subscription has a thread of its own, so a batch or a purge does not hold up the single alarm updates
+    m_batchSub = m_session.onRPCAction(batchRpcPrefix, [&](sysrepo::Session session, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) {
+        if (isExternalOriginator(session)) {
+            return rejectExternalOriginator(session);
+        }
+        return submitAlarms(input, output);
+    });
+    m_maintenanceSub = m_session.onRPCAction(purgeRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return purgeAlarms(purgeRpcPrefix, input, output); });
+    m_maintenanceSub->onRPCAction(purgeShelvedRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return purgeAlarms(purgeShelvedRpcPrefix, input, output); });
+    m_maintenanceSub->onRPCAction(compressAlarmsRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return compressAlarms(compressAlarmsRpcPrefix, input, output); });
+    m_maintenanceSub->onRPCAction(compressShelvedAlarmsRpcPrefix, [&](auto, auto, auto, const libyang::DataNode input, auto, auto, libyang::DataNode output) { return compressAlarms(compressShelvedAlarmsRpcPrefix, input, output); });
 
     {
         utils::ScopedDatastoreSwitch sw(m_session, sysrepo::Datastore::Running);
-        m_alarmSub->onModuleChange(
+        m_controlSub = m_session.onModuleChange(
             ietfAlarmsModule,
             [&](auto session, auto, auto, auto, auto, auto) {
                 WITH_TIME_MEASUREMENT{controlPrefix};
-                bool needsReshelve = false;
-                bool needsStatusChangesShrink = false;
-                std::unique_lock lck{m_mtx};
+                auto settings = m_engine.settings();
+                std::optional<ShelvingRules> shelvingRules;
                 for (const auto& change : session.getChanges()) {
                     const auto xpath = change.node.path();
                     if (boost::algorithm::starts_with(xpath, ctrlShelving)) {
-                        needsReshelve = true;
+                        if (auto config = session.getData(ctrlShelving)) {
+                            m_engine.learnIdentities(session.getContext());
+                            shelvingRules = m_engine.compileShelvingRules(config->findXPath(ctrlShelving + "/shelf"));
+                        } else {
+                            shelvingRules = ShelvingRules{};
+                        }
                         break;
                     }
                     if (xpath == ctrlNotifyStatusChanges) {
                         auto val = std::get<libyang::Enum>(change.node.asTerm().value());
                         if (val.name == "all-state-changes") {
-                            m_notifyStatusChanges = NotifyStatusChanges::All;
+                            settings.notifyStatusChanges = NotifyStatusChanges::All;
                             m_log->debug("Will notify about any alarm state changes");
                         } else if (val.name == "raise-and-clear") {
-                            m_notifyStatusChanges = NotifyStatusChanges::RaiseAndClear;
+                            settings.notifyStatusChanges = NotifyStatusChanges::RaiseAndClear;
                             m_log->debug("Will notify about raised and cleared alarms");
                         } else if (val.name == "severity-level") {
-                            m_notifyStatusChanges = NotifyStatusChanges::BySeverity;
+                            settings.notifyStatusChanges = NotifyStatusChanges::BySeverity;
                         } else {
                             throw std::runtime_error{"Cannot handle " + ctrlNotifyStatusChanges + " value " + val.name};
                         }
@@ -138,42 +354,31 @@ Daemon::Daemon()
                     }
                     if (xpath == ctrlNotifySeverityLevel) {
                         if (change.operation == sysrepo::ChangeOperation::Deleted) {
-                            m_notifySeverityThreshold = std::nullopt;
+                            settings.notifySeverityThreshold = std::nullopt;
                         } else {
                             auto value = std::get<libyang::Enum>(change.node.asTerm().value());
-                            m_notifySeverityThreshold = value.value;
+                            settings.notifySeverityThreshold = value.value;
                             m_log->debug("Will notify about alarms with perceived-severity >= {}", value.name);
                         }
                         continue;
                     }
                     if (xpath == ctrlMaxAlarmStatusChanges) {
-                        auto oldVal = m_maxAlarmStatusChanges;
                         auto node = change.node.asTerm();
 
                         // type of the node is union{uint16, Enum{infinite}}
                         if (std::holds_alternative<uint16_t>(node.value())) {
-                            m_maxAlarmStatusChanges = std::get<uint16_t>(node.value());
+                            settings.maxAlarmStatusChanges = std::get<uint16_t>(node.value());
                         } else {
-                            m_maxAlarmStatusChanges = std::nullopt;
+                            settings.maxAlarmStatusChanges = std::nullopt;
                         }
                         m_log->debug("Will limit status changes history to {}", node.valueStr());
-
-                        if (m_maxAlarmStatusChanges && (!oldVal || *m_maxAlarmStatusChanges < *oldVal)) {
-                            needsStatusChangesShrink = true;
-                        }
                     }
                 }
-                bool changed = false;
-                if (needsReshelve) {
-                    changed |= reshelve(session);
-                }
-                if (needsStatusChangesShrink) {
-                    changed |= shrinkStatusChangesLists();
-                }
-                if (changed) {
+
+                if (m_engine.reconfigure(settings, std::move(shelvingRules))) {
+                    std::unique_lock lck{m_mtx};
                     utils::ScopedDatastoreSwitch sw(m_session, sysrepo::Datastore::Operational);
-                    m_session.editBatch(*m_edit, sysrepo::DefaultOperation::Replace);
-                    m_session.applyChanges();
+                    publishNow();
                 }
                 return sysrepo::ErrorCode::Ok;
             },
@@ -182,19 +387,31 @@ Daemon::Daemon()
             sysrepo::SubscribeOptions::Enabled | sysrepo::SubscribeOptions::DoneOnly);
     }
 
-    m_inventorySub = m_session.onModuleChange(
-        ietfAlarmsModule, [&](auto, auto, auto, auto, auto, auto) {
-            WITH_TIME_MEASUREMENT{alarmInventoryPrefix};
-            {
-                std::unique_lock lck{m_mtx};
-                m_inventoryDirty = true;
+    if (publishing == Publishing::OnDemand) {
+        m_log->info("Alarm lists and the summary are rendered on demand");
+        // a dedicated subscription (and thread) so that the providers never wait for the RPC handlers
+        for (const auto& subtree : {alarmList, shelvedAlarmList, alarmSummaryPrefix}) {
+            auto cb = [this, subtree](auto, auto, auto, auto, const std::optional<std::string_view> requestXPath, auto, std::optional<libyang::DataNode>& output) {
+                return provideOperationalData(subtree, requestXPath, output);
+            };
+            if (!m_operSub) {
+                m_operSub = m_session.onOperGet(ietfAlarmsModule, cb, subtree);
+            } else {
+                m_operSub->onOperGet(ietfAlarmsModule, cb, subtree);
             }
-            m_session.sendNotification(m_session.getContext().newPath("/ietf-alarms:alarm-inventory-changed", std::nullopt), sysrepo::Wait::No);
-            return sysrepo::ErrorCode::Ok;
-        },
-        alarmInventoryPrefix,
-        0,
-        sysrepo::SubscribeOptions::Enabled | sysrepo::SubscribeOptions::DoneOnly);
+        }
+    }
+
+    if (m_writeBehind) {
+        m_log->info("Write-behind: publishing alarm updates once per {}ms or once {} updates are pending", m_writeBehind->window.count(), m_writeBehind->maxPendingUpdates);
+        m_flusher = std::thread([this]() { flushWhenDue(); });
+    }
+
+    if (m_engine.flapDamping()) {
+        m_summarizer = std::thread([this]() { summarizeDampedAlarms(); });
+    }
+
+    m_inventoryRebuilder = std::thread([this]() { rebuildInventoryWhenRequested(); });
 }
 
 /** @brief Check whether published alarm is in alarm-inventory container
@@ -206,281 +423,665 @@ Daemon::Daemon()
  *
  * @return optional<string> containing the error message if validation fails
  * */
-std::optional<std::string> Daemon::inventoryValidationError(const InstanceKey& key, const int32_t severity)
+std::optional<std::string> Daemon::inventoryValidationError(const InstanceKey& key, const int32_t severity) const
 {
-    auto it = m_inventory.find(key.type);
-    if (it == m_inventory.end()) {
+    // no locking, the snapshot is never modified once it's published
+    const auto inventory = m_inventory.load();
+    auto it = inventory->find(key.type);
+    if (it == inventory->end()) {
         return "No alarm inventory entry for " + key.type.xpathIndex();
     }
 
-    if (it->second.resources.size() && !it->second.resources.contains(key.resource)) {
+    const auto& allowed = *it->second;
+    if (allowed.resources.size() && !allowed.resources.contains(key.resource)) {
         return "Alarm inventory doesn't allow resource '" + key.resource + "' for " + key.type.xpathIndex();
     }
 
-    if (it->second.severities.size() && severity != ClearedSeverity && !it->second.severities.contains(severity)) {
+    if (allowed.severities.size() && severity != ClearedSeverity && !allowed.severities.contains(severity)) {
         return "Alarm inventory doesn't allow severity '"s + Severities[severity] + "' for " + key.type.xpathIndex();
     }
 
     return std::nullopt;
 }
 
-/** @short Propagate changes from an incoming RPC to the cached alarm info
+/** @brief Adds new entry to alarm's status-change list
  *
- * The entry that's being modified might not have existed in the cache. In that case, it's a new alarm,
- * and this function is called on a default-constructed AlarmEntry.
+ * The statusChangeNodes are the existing status-change nodes of that alarm, the oldest one first.
  * */
-AlarmEntry::WhatChanged AlarmEntry::updateByRpc(
-        const bool wasPresent,
-        const TimePoint now,
-        const libyang::DataNode& input,
-        const std::optional<std::string> shelf,
-        const NotifyStatusChanges notifyStatusChanges,
-        const std::optional<int32_t> notifySeverityThreshold,
-        const std::optional<uint16_t> maxAlarmStatusChanges)
+void updateStatusChangeList(libyang::DataNode& alarmNode, std::deque<libyang::DataNode>& statusChangeNodes, const AlarmEntry& alarm, const utils::YangTimeFormatter& yangTimeFormat)
 {
-    const auto severity = std::get<libyang::Enum>(input.findPath("severity").value().asTerm().value()).value;
-    const bool isClearedNow = severity == ClearedSeverity;
+    /* ietf-alarms specifies the status-change list as follows:
+     * > The entry with latest timestamp in this list MUST correspond to the leafs 'is-cleared', 'perceived-severity', and 'alarm-text' for the alarm.
+     * > This list is ordered according to the timestamps of alarm state changes. The first item corresponds to the latest state change.
+     *
+     * This means that we have to insert new status-change entries at the beginning of the list.
+     *
+     * Further,
+     * > The 'status-change' entries are kept in a circular list per alarm.
+     * > When this number is exceeded, the oldest status change entry is automatically removed.
+     * > If the value is 'infinite', the status-change entries are accumulated infinitely.
+     *
+     * This means we must be clearing the oldest entries when the list is too long. The cache keeps them in a circular
+     * list as well, see StatusChangeHistory. Each update drops at most one entry; that's up to the caller.
+     */
+
+    auto node = newStatusChangeNode(alarmNode, alarm.lastChanged, alarm.isCleared ? ClearedSeverity : alarm.lastSeverity, alarm.text, yangTimeFormat);
+
+    if (!statusChangeNodes.empty()) {
+        // move to the correct position as the first node in that list
+        node.insertBefore(statusChangeNodes.back());
+    }
+    statusChangeNodes.push_back(node);
+}
 
-    // If the update clears and alarm and that alarm was not present before, we don't know
-    // what to store into the `isCleared`. This must be handled prior to default-constructing
-    // the new entry in m_alarms in Daemon::submitAlarm.
-    assert(!isClearedNow || wasPresent);
+/** @brief Add or remove the leaf which says that an alarm is damped
+ *
+ * @return whether the leaf has been added or removed
+ * */
+bool updateFlappingLeaf(libyang::DataNode& alarmNode, std::optional<libyang::DataNode>& flappingNode, const AlarmEntry& alarm)
+{
+    if (alarm.flapping.damped && !flappingNode) {
+        flappingNode = alarmNode.newPath(flappingLeaf);
+        return true;
+    } else if (!alarm.flapping.damped && flappingNode) {
+        flappingNode->unlink();
+        flappingNode = std::nullopt;
+        return true;
+    }
+    return false;
+}
+
+/** @brief Find the nodes of an alarm in m_edit, creating the alarm node if it is not there yet. Must be called with m_mtx locked. */
+Daemon::AlarmNodes& Daemon::alarmNodes(const InstanceKey& alarmKey, const AlarmEntry& alarm)
+{
+    if (auto it = m_alarmNodes.find(alarmKey); it != m_alarmNodes.end()) {
+        return it->second;
+    }
+
+    auto node = newAlarmNode(*m_edit, alarmKey, !!alarm.shelf);
+    renderAlarmLeaves(node, alarm, m_timeFormatter);
 
-    WhatChanged res {
-        .changed = false,
-        .shouldNotify = false,
-        .removedStatusChanges = {},
+    auto leaf = [&node](const std::string& name) {
+        return node.findPath(name)->asTerm();
     };
+    AlarmNodes nodes{
+        .alarm = node,
+        .isCleared = leaf("is-cleared"),
+        .lastRaised = leaf("last-raised"),
+        .lastChanged = leaf("last-changed"),
+        .perceivedSeverity = leaf("perceived-severity"),
+        .alarmText = leaf("alarm-text"),
+        .flapping = node.findPath(flappingLeaf),
+        .statusChanges = {},
+    };
+    return m_alarmNodes.emplace(alarmKey, std::move(nodes)).first->second;
+}
+
+/** @brief Remove the oldest status-change entry of an alarm from m_edit. Must be called with m_mtx locked. */
+void Daemon::removeOldestStatusChange(const InstanceKey& alarmKey, const AlarmEntry& alarm, const TimePoint& time)
+{
+    auto& nodes = m_alarmNodes.at(alarmKey);
+    m_unpublished.statusChangeRemoved({alarmKey, !!alarm.shelf}, m_timeFormatter(time), nodes.statusChanges.size());
+    nodes.statusChanges.front().unlink();
+    nodes.statusChanges.pop_front();
+}
+
+/** @brief Move the node of an alarm whose shelf has changed into the other alarm list within m_edit
+ *
+ * All the nodes are moved over, so that the cached nodes of this alarm remain valid. Must be called with m_mtx locked.
+ * */
+void Daemon::moveAlarmNode(const InstanceKey& alarmKey, const AlarmEntry& alarm)
+{
+    auto& nodes = m_alarmNodes.at(alarmKey);
+    auto node = newAlarmNode(*m_edit, alarmKey, !!alarm.shelf);
+    if (alarm.shelf) {
+        node.newPath("shelf-name", *alarm.shelf);
+    } else {
+        node.newPath("time-created", m_timeFormatter(alarm.created));
+    }
+    for (libyang::DataNode leaf : {nodes.isCleared, nodes.lastRaised, nodes.lastChanged, nodes.perceivedSeverity, nodes.alarmText}) {
+        leaf.unlink();
+        node.insertChild(leaf);
+    }
+    if (nodes.flapping) {
+        nodes.flapping->unlink();
+        node.insertChild(*nodes.flapping);
+    }
+    // the latest change comes first in the tree
+    for (auto it = nodes.statusChanges.rbegin(); it != nodes.statusChanges.rend(); ++it) {
+        it->unlink();
+        node.insertChild(*it);
+    }
+    nodes.alarm.unlink();
+    nodes.alarm = node;
+}
+
+/** @short Validate a single alarm update, and pass it on to the engine
+ *
+ * The engine queues the change and its notification via alarmUpdated(). This does not publish anything to sysrepo;
+ * that's up to the caller. The alarm identity should be resolved already.
+ */
+Daemon::AlarmUpdate Daemon::updateAlarm(const TimePoint now, const InstanceKey& alarmKey, const libyang::DataNode& input)
+{
+    const auto severity = std::get<libyang::Enum>(input.findPath("severity").value().asTerm().value()).value;
+
+    if (auto inventoryError = inventoryValidationError(alarmKey, severity)) {
+        m_log->warn(inventoryError.value());
+        return {.errorCode = sysrepo::ErrorCode::OperationFailed, .errorMessage = inventoryError.value() + " -- see RFC8632 (sec. 4.1).", .changed = false};
+    }
 
-    if (!wasPresent) {
-        // Shelving status does not depend on "alarm updates" (which are handled here); whether an alarm is shelved
-        // or not shelved is only determined by the /ietf-alarms:alarms/control/alarm-shelving.
-        // We don't have to track updates here.
-        this->shelf = shelf;
+    const auto changed = m_engine.update(now, {.key = alarmKey, .severity = severity, .text = utils::childValue(input, "alarm-text")});
+    return {.errorCode = sysrepo::ErrorCode::Ok, .errorMessage = {}, .changed = changed};
+}
 
-        // this one only gets assigned at the very beginning of an alarm lifetime
-        this->created = now;
+Daemon::PendingSlice& Daemon::pendingSlice(const InstanceKey& alarmKey)
+{
+    return m_pending[boost::hash<InstanceKey>{}(alarmKey) % m_pending.size()];
+}
 
-        // -1 is an invalid value which compares different to anything legal later on
-        this->lastSeverity = -1;
+/** @brief Queue a changed alarm to be rendered into m_edit, and its notification to be sent once the change is published
+ *
+ * This is called with the engine's lock of that alarm held, so it does not touch m_edit. Instead, the change waits
+ * in its PendingSlice until the next publishNow().
+ * */
+void Daemon::alarmUpdated(const InstanceKey& alarmKey, const AlarmEntry& alarm, const AlarmEngine::AlarmChange& change)
+{
+    if (change.dampingStarted) {
+        std::unique_lock lck{m_summaryMtx};
+        m_summaryRequested.notify_all();
+    }
+    if (!m_edit && m_log->should_log(spdlog::level::debug)) {
+        m_log->debug("Updated alarm: {}", alarmKey.xpathIndex());
     }
 
-    if (wasPresent && this->isCleared != isClearedNow) {
-        res.changed = true;
+    auto& slice = pendingSlice(alarmKey);
+    std::unique_lock lck{slice.mtx};
+    if (m_edit) {
+        slice.changes.push_back({.kind = PendingChange::Kind::Updated, .key = alarmKey, .alarm = withoutHistory(alarm), .newStatusChange = change.newStatusChange, .removedStatusChange = change.removedStatusChange, .previousShelf = std::nullopt});
+    }
+    if (change.notify) {
+        // the sequence number is taken with the slice locked, see publishNow()
+        slice.notifications.emplace_back(m_notificationSequence++, StatusChangeNotification{alarmKey, alarm.lastChanged, alarm.isCleared ? ClearedSeverity : alarm.lastSeverity, alarm.text});
     }
+}
 
-    if (auto text = utils::childValue(input, "alarm-text"); text != this->text) {
-        this->text = text;
-        res.changed = true;
+void Daemon::alarmRemoved(const InstanceKey& alarmKey, const AlarmEntry& alarm)
+{
+    if (m_edit) {
+        auto& slice = pendingSlice(alarmKey);
+        std::unique_lock lck{slice.mtx};
+        slice.changes.push_back({.kind = PendingChange::Kind::Removed, .key = alarmKey, .alarm = withoutHistory(alarm), .newStatusChange = false, .removedStatusChange = std::nullopt, .previousShelf = std::nullopt});
     }
+}
 
-    if (isClearedNow || notifyStatusChanges == NotifyStatusChanges::All) {
-        res.shouldNotify = true;
-    } else if (notifyStatusChanges == NotifyStatusChanges::RaiseAndClear) {
-        res.shouldNotify = !wasPresent || (isClearedNow != this->isCleared);
+void Daemon::statusChangeRemoved(const InstanceKey& alarmKey, const AlarmEntry& alarm, const TimePoint& time)
+{
+    if (m_edit) {
+        auto& slice = pendingSlice(alarmKey);
+        std::unique_lock lck{slice.mtx};
+        slice.changes.push_back({.kind = PendingChange::Kind::StatusChangeRemoved, .key = alarmKey, .alarm = withoutHistory(alarm), .newStatusChange = false, .removedStatusChange = time, .previousShelf = std::nullopt});
     }
+}
 
-    if (severity != this->lastSeverity /* evaluates true also for previously unseen alarm keys */) {
-        res.changed = true;
+void Daemon::alarmReshelved(const InstanceKey& alarmKey, const AlarmEntry& alarm, const std::optional<std::string>& previousShelf)
+{
+    if (m_edit) {
+        auto& slice = pendingSlice(alarmKey);
+        std::unique_lock lck{slice.mtx};
+        slice.changes.push_back({.kind = PendingChange::Kind::Reshelved, .key = alarmKey, .alarm = withoutHistory(alarm), .newStatusChange = false, .removedStatusChange = std::nullopt, .previousShelf = previousShelf});
     }
+}
 
-    if (!isClearedNow) {
-        if (!wasPresent || (wasPresent && this->isCleared)) {
-            this->lastRaised = now;
+/** @brief Render a change which was queued by one of the engine callbacks into m_edit. Must be called with m_mtx locked. */
+void Daemon::renderPendingChange(const PendingChange& change)
+{
+    const auto& [kind, alarmKey, alarm, newStatusChange, removedStatusChange, previousShelf] = change;
+    switch (kind) {
+    case PendingChange::Kind::Updated:
+        renderAlarmUpdate(alarmKey, alarm, newStatusChange, removedStatusChange);
+        break;
+    case PendingChange::Kind::Removed:
+        m_alarmNodes.at(alarmKey).alarm.unlink();
+        m_alarmNodes.erase(alarmKey);
+        m_unpublished.alarmRemoved({alarmKey, !!alarm.shelf});
+        break;
+    case PendingChange::Kind::StatusChangeRemoved:
+        removeOldestStatusChange(alarmKey, alarm, *removedStatusChange);
+        break;
+    case PendingChange::Kind::Reshelved:
+        if (!!previousShelf != !!alarm.shelf) {
+            moveAlarmNode(alarmKey, alarm);
+            m_unpublished.alarmRemoved({alarmKey, !!previousShelf});
+            m_unpublished.alarmAdded({alarmKey, !!alarm.shelf});
+        } else {
+            m_alarmNodes.at(alarmKey).alarm.newPath("shelf-name", *alarm.shelf, libyang::CreationOptions::Update);
+            m_unpublished.leavesChanged({alarmKey, true}, UnpublishedChanges::ShelfName);
         }
-        if (notifyStatusChanges == NotifyStatusChanges::BySeverity &&
-                (severity >= *notifySeverityThreshold || this->lastSeverity >= *notifySeverityThreshold)) {
-            res.shouldNotify = true;
+        break;
+    }
+}
+
+/** @brief Render a changed alarm into m_edit, including its newest status-change entry if there is a new one. Must be called with m_mtx locked. */
+void Daemon::renderAlarmUpdate(const InstanceKey& alarmKey, const AlarmEntry& alarm, const bool newStatusChange, const std::optional<TimePoint>& removedStatusChange)
+{
+    const UnpublishedChanges::Alarm unpublished{alarmKey, !!alarm.shelf};
+    if (!m_alarmNodes.contains(alarmKey)) {
+        m_unpublished.alarmAdded(unpublished);
+    }
+
+    // shelf-name and time-created only change through reshelving
+    auto& nodes = alarmNodes(alarmKey, alarm);
+    uint8_t leaves = 0;
+    auto changeLeaf = [&leaves](libyang::DataNodeTerm& leaf, const std::string& value, const UnpublishedChanges::Leaf which) {
+        if (leaf.changeValue(value) == libyang::ValueChange::Changed) {
+            leaves |= which;
         }
-        if (severity > ClearedSeverity) {
-            this->lastSeverity = severity;
+    };
+    changeLeaf(nodes.isCleared, alarm.isCleared ? "true" : "false", UnpublishedChanges::IsCleared);
+    changeLeaf(nodes.lastRaised, m_timeFormatter(alarm.lastRaised), UnpublishedChanges::LastRaised);
+    changeLeaf(nodes.lastChanged, m_timeFormatter(alarm.lastChanged), UnpublishedChanges::LastChanged);
+    changeLeaf(nodes.perceivedSeverity, Severities[alarm.lastSeverity], UnpublishedChanges::PerceivedSeverity);
+    changeLeaf(nodes.alarmText, alarm.text, UnpublishedChanges::AlarmText);
+    if (updateFlappingLeaf(nodes.alarm, nodes.flapping, alarm)) {
+        leaves |= UnpublishedChanges::Flapping;
+    }
+    m_unpublished.leavesChanged(unpublished, leaves);
+    if (newStatusChange) {
+        updateStatusChangeList(nodes.alarm, nodes.statusChanges, alarm, m_timeFormatter);
+        m_unpublished.statusChangeAdded(unpublished);
+        if (removedStatusChange) {
+            removeOldestStatusChange(alarmKey, alarm, *removedStatusChange);
         }
     }
-    this->isCleared = severity == ClearedSeverity;
-
-    if (res.changed) {
-        this->lastChanged = now;
+    if (m_log->should_log(spdlog::level::debug)) {
+        m_log->debug("Updated alarm: {}", *nodes.alarm.printStr(libyang::DataFormat::JSON, libyang::PrintFlags::Shrink));
+    }
+}
 
-        this->statusChanges.emplace_back(now, this->lastSeverity, this->text);
-        res.removedStatusChanges = shrinkStatusChanges(maxAlarmStatusChanges);
+/** @brief Find the index of an alarm-type-id in the identity table, learning about new identities when the schema has changed */
+std::optional<IdentityTable::Index> Daemon::resolveIdentity(const std::string& alarmTypeId)
+{
+    if (auto index = m_engine.findIdentity(alarmTypeId)) {
+        return index;
     }
 
-    return res;
+    if (m_engine.learnIdentities(m_session.getContext())) {
+        m_log->debug("Alarm type identities have changed");
+    }
+    return m_engine.findIdentity(alarmTypeId);
 }
 
-std::vector<TimePoint> AlarmEntry::shrinkStatusChanges(const std::optional<uint16_t> maxAlarmStatusChanges)
+/** @short Publish alarm updates to sysrepo, either right away, or later on in the write-behind mode
+ *
+ * The queued notifications are sent once the data are published. Must be called with m_mtx held.
+ */
+void Daemon::publishAlarms(const unsigned updates)
 {
-    std::vector<TimePoint> res;
+    if (!m_pendingUpdates && m_writeBehind) {
+        m_flushDeadline = std::chrono::steady_clock::now() + m_writeBehind->window;
+        m_flushRequested.notify_all();
+    }
+    m_pendingUpdates += updates;
 
-    if (maxAlarmStatusChanges && statusChanges.size() > *maxAlarmStatusChanges) {
-        size_t toErase = statusChanges.size() - *maxAlarmStatusChanges;
+    if (!m_writeBehind || m_pendingUpdates >= m_writeBehind->maxPendingUpdates) {
+        publishNow();
+    }
+}
 
-        std::transform(statusChanges.begin(), statusChanges.begin() + toErase, std::back_inserter(res), [](const auto& statusChange) {
-            return statusChange.time;
-        });
+/** @brief Publish everything that is pending. Must be called with m_mtx held. */
+void Daemon::publishNow()
+{
+    m_engine.flushJournal();
+
+    /* Notifications are sent in the order in which the engine produced them. The ones which got their sequence number
+     * after this point might be in a slice which has been drained already, so they wait for the next round, along with
+     * everything that comes after them. */
+    const auto notificationsUpTo = m_notificationSequence.load();
+    std::vector<PendingChange> changes;
+    std::vector<std::pair<uint64_t, StatusChangeNotification>> notifications;
+    for (auto& slice : m_pending) {
+        {
+            std::unique_lock lck{slice.mtx};
+            std::swap(changes, slice.changes);
+            auto due = std::find_if(slice.notifications.begin(), slice.notifications.end(), [notificationsUpTo](const auto& n) { return n.first >= notificationsUpTo; });
+            std::move(slice.notifications.begin(), due, std::back_inserter(notifications));
+            slice.notifications.erase(slice.notifications.begin(), due);
+        }
+        // changes of a single alarm always end up in the same slice, so their order is preserved
+        for (const auto& change : changes) {
+            renderPendingChange(change);
+        }
+        changes.clear();
+    }
 
-        statusChanges.erase(statusChanges.begin(), statusChanges.begin() + toErase);
+    if (m_edit) {
+        updateStatistics();
+        // whoever publishes first takes the changes of the others along, and the rest has nothing left to do
+        if (!m_unpublished.empty()) {
+            m_session.editBatch(unpublishedChangesEdit(), sysrepo::DefaultOperation::Merge);
+            WITH_TIME_MEASUREMENT{"submitAlarm/applyChanges"};
+            m_session.applyChanges();
+        }
+    }
+    if (m_writeBehind && m_pendingUpdates) {
+        m_log->debug("Write-behind: published {} alarm updates at once", m_pendingUpdates);
     }
+    m_pendingUpdates = 0;
 
-    return res;
+    std::sort(notifications.begin(), notifications.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (auto& [sequence, notification] : notifications) {
+        m_notifications.enqueue(std::move(notification));
+    }
 }
 
-/** @brief Adds new entry to alarm's status-change list */
-void updateStatusChangeList(libyang::DataNode& edit, const std::string& alarmNodePath, AlarmEntry& alarm, const std::vector<TimePoint>& removedStatusChanges)
+/** @short Render the requested part of the alarm lists or of the alarm summary from the cache
+ *
+ * This is the operational data provider which is used when publishing on demand.
+ * */
+sysrepo::ErrorCode Daemon::provideOperationalData(const std::string& subtree, const std::optional<std::string_view>& requestXPath, std::optional<libyang::DataNode>& output)
 {
-    /* ietf-alarms specifies the status-change list as follows:
-     * > The entry with latest timestamp in this list MUST correspond to the leafs 'is-cleared', 'perceived-severity', and 'alarm-text' for the alarm.
-     * > This list is ordered according to the timestamps of alarm state changes. The first item corresponds to the latest state change.
-     *
-     * This means that we have to insert new status-change entries at the beginning of the list.
-     *
-     * Further,
-     * > The 'status-change' entries are kept in a circular list per alarm.
-     * > When this number is exceeded, the oldest status change entry is automatically removed.
-     * > If the value is 'infinite', the status-change entries are accumulated infinitely.
-     *
-     * This means we must be clearing the oldest entries when the list is too long.
-     * Our implementation does not use circular list, but std::vector, so we std::move stuff in the vector, but that is our implementation detail.
-     */
+    WITH_TIME_MEASUREMENT{subtree};
 
-    auto firstExistingChange = [&]() -> std::optional<libyang::DataNode> {
-        auto alarmNode = edit.findPath(alarmNodePath);
-        for (const auto& child : alarmNode->immediateChildren()) {
-            if (child.schema().name() == "status-change" && child.schema().module().name() == "ietf-alarms") {
-                return child;
-            }
+    // the statistics are read without locking any shards
+    if (!output) {
+        output = m_session.getContext().newPath(rootPath);
+    }
+    for (const auto& [path, value] : statisticsLeaves()) {
+        if (path.starts_with(subtree)) {
+            output->newPath(path, value, libyang::CreationOptions::Update);
+        }
+    }
+
+    if (subtree == alarmSummaryPrefix) {
+        return sysrepo::ErrorCode::Ok;
+    }
+
+    const bool doingShelved = subtree == shelvedAlarmList;
+    const auto keys = requestedAlarmKeys(requestXPath, doingShelved ? shelvedAlarmListInstances : alarmListInstances);
+    if (!keys) {
+        return sysrepo::ErrorCode::Ok;
+    }
+
+    auto requested = [&keys](const char* name) -> std::optional<std::string> {
+        if (auto it = keys->find(name); it != keys->end()) {
+            return it->second;
         }
         return std::nullopt;
-    }();
+    };
+    const auto resource = requested("resource");
+    const auto id = requested("alarm-type-id");
+    const auto qualifier = requested("alarm-type-qualifier");
+
+    if (resource && id && qualifier) {
+        // the identity might be spelled in some other way than what we use, so fall back to a full scan on a miss
+        const InstanceKey key{{*id, *qualifier}, *resource};
+        const bool found = m_engine.visit(key, [&](const AlarmEntry& alarm) {
+            if (doingShelved == !!alarm.shelf) {
+                renderAlarm(*output, key, alarm, m_timeFormatter);
+            }
+        });
+        if (found) {
+            return sysrepo::ErrorCode::Ok;
+        }
+    }
 
-    auto statusChange = statusChangeXPath(alarmNodePath, alarm.lastChanged);
-    auto node = *edit.newPath2(statusChange, std::nullopt).createdNode;
-    node.newPath(statusChange + "/perceived-severity", Severities[alarm.isCleared ? ClearedSeverity : alarm.lastSeverity]);
-    node.newPath(statusChange + "/alarm-text", alarm.text);
+    m_engine.forEach([&](const InstanceKey& key, const AlarmEntry& alarm) {
+        if (doingShelved != !!alarm.shelf || (resource && *resource != key.resource) || (qualifier && *qualifier != key.type.qualifier)) {
+            return;
+        }
+        renderAlarm(*output, key, alarm, m_timeFormatter);
+    });
+    return sysrepo::ErrorCode::Ok;
+}
 
-    if (firstExistingChange) {
-        // move to the correct position as the first node in that list
-        node.insertBefore(*firstExistingChange);
+namespace {
+void setOperation(const libyang::Module& ietfNetconf, libyang::DataNode node, const std::string& operation)
+{
+    node.newMeta(ietfNetconf, "operation", operation);
+}
+}
+
+/** @short Build an edit which only contains what has changed since the last time anything was published
+ *
+ * New alarms, and alarms which have moved to the other list, are replaced as a whole. Other alarms only get their
+ * changed leaves and their new status-change entries merged. The removed alarms, the removed status-change entries
+ * and a removed flapping leaf are represented by a "remove" operation.
+ * */
+libyang::DataNode Daemon::unpublishedChangesEdit()
+{
+    const auto ietfNetconf = m_session.getContext().getModuleImplemented("ietf-netconf");
+    if (!ietfNetconf) {
+        throw std::runtime_error{"ietf-netconf is not implemented in sysrepo"};
+    }
+
+    auto edit = m_session.getContext().newPath(rootPath);
+
+    for (const auto& leafPath : m_unpublished.statisticsLeaves) {
+        edit.newPath(leafPath, m_publishedStatistics.at(leafPath), libyang::CreationOptions::Update);
+    }
+
+    for (const auto& [key, shelved] : m_unpublished.removedAlarms) {
+        setOperation(*ietfNetconf, newAlarmNode(edit, key, shelved), "remove");
     }
 
-    for (const auto& time: removedStatusChanges) {
-        edit.findPath(statusChangeXPath(alarmNodePath, time))->unlink();
+    for (const auto& [alarm, changes] : m_unpublished.alarms) {
+        const auto& [key, shelved] = alarm;
+        const auto& nodes = m_alarmNodes.at(key);
+
+        if (changes.whole) {
+            auto copy = *nodes.alarm.duplicate(libyang::DuplicationOptions::Recursive);
+            findOrCreate(edit, shelved ? shelvedAlarmList : alarmList).insertChild(copy);
+            setOperation(*ietfNetconf, copy, "replace");
+            continue;
+        }
+
+        auto node = newAlarmNode(edit, key, shelved);
+        auto mergeLeaf = [&](const UnpublishedChanges::Leaf which, const std::string& name, const libyang::DataNodeTerm& leaf) {
+            if (changes.leaves & which) {
+                node.newPath(name, leaf.valueStr());
+            }
+        };
+        mergeLeaf(UnpublishedChanges::IsCleared, "is-cleared", nodes.isCleared);
+        mergeLeaf(UnpublishedChanges::LastRaised, "last-raised", nodes.lastRaised);
+        mergeLeaf(UnpublishedChanges::LastChanged, "last-changed", nodes.lastChanged);
+        mergeLeaf(UnpublishedChanges::PerceivedSeverity, "perceived-severity", nodes.perceivedSeverity);
+        mergeLeaf(UnpublishedChanges::AlarmText, "alarm-text", nodes.alarmText);
+        if (changes.leaves & UnpublishedChanges::ShelfName) {
+            node.newPath("shelf-name", utils::childValue(nodes.alarm, "shelf-name"));
+        }
+        if (changes.leaves & UnpublishedChanges::Flapping) {
+            auto flapping = *node.newPath(flappingLeaf);
+            if (!nodes.flapping) {
+                setOperation(*ietfNetconf, flapping, "remove");
+            }
+        }
+
+        // status-change is ordered by the system, so the position of the new entries is up to sysrepo
+        for (auto it = nodes.statusChanges.end() - changes.newStatusChanges; it != nodes.statusChanges.end(); ++it) {
+            node.insertChild(*it->duplicate(libyang::DuplicationOptions::Recursive));
+        }
+        for (const auto& time : changes.removedStatusChanges) {
+            setOperation(*ietfNetconf, utils::newListInstance(node, "status-change", {time}), "remove");
+        }
     }
+
+    m_unpublished = {};
+    return edit;
 }
 
-bool Daemon::shrinkStatusChangesLists()
+bool Daemon::UnpublishedChanges::empty() const
 {
-    WITH_TIME_MEASUREMENT{};
-    bool changed = false;
+    return alarms.empty() && removedAlarms.empty() && statisticsLeaves.empty();
+}
 
-    if (!m_maxAlarmStatusChanges) {
-        return false;
+/** @brief A new alarm node, or one which has moved to the other list */
+void Daemon::UnpublishedChanges::alarmAdded(const Alarm& alarm)
+{
+    removedAlarms.erase(alarm);
+    alarms[alarm] = {.whole = true, .leaves = 0, .newStatusChanges = 0, .removedStatusChanges = {}};
+}
+
+void Daemon::UnpublishedChanges::leavesChanged(const Alarm& alarm, const uint8_t leaves)
+{
+    if (leaves) {
+        alarms[alarm].leaves |= leaves;
     }
+}
+
+/** @brief A new status-change entry has been appended after all the existing ones */
+void Daemon::UnpublishedChanges::statusChangeAdded(const Alarm& alarm)
+{
+    ++alarms[alarm].newStatusChanges;
+}
+
+void Daemon::UnpublishedChanges::alarmRemoved(const Alarm& alarm)
+{
+    alarms.erase(alarm);
+    removedAlarms.insert(alarm);
+}
 
-    m_log->debug("Trimming status changes history because max-alarm-status-changes changed to {}", *m_maxAlarmStatusChanges);
+/** @brief The oldest of the alarm's statusChanges entries is going away */
+void Daemon::UnpublishedChanges::statusChangeRemoved(const Alarm& alarm, const std::string& time, const size_t statusChanges)
+{
+    auto& changes = alarms[alarm];
+    if (changes.whole) {
+        // the alarm gets replaced as a whole, including its status-change entries
+        return;
+    }
+    if (changes.newStatusChanges == statusChanges) {
+        // all entries are new, so the oldest one has never been published
+        --changes.newStatusChanges;
+        return;
+    }
+    changes.removedStatusChanges.push_back(time);
+}
 
-    for (auto& [alarmKey, alarm] : m_alarms) {
-        for (const auto& time : alarm.shrinkStatusChanges(m_maxAlarmStatusChanges)) {
-            const auto& prefix = alarm.shelf ? shelvedAlarmListInstances : alarmListInstances;
-            const auto xpath = statusChangeXPath(prefix + alarmKey.xpathIndex(), time);
-            m_edit->findPath(xpath)->unlink();
-            changed = true;
+/** @brief Body of the write-behind thread which publishes the pending alarm updates once their time window expires */
+void Daemon::flushWhenDue()
+{
+    std::unique_lock lck{m_mtx};
+    while (!m_stopFlushing) {
+        if (!m_pendingUpdates) {
+            m_flushRequested.wait(lck, [this]() { return m_stopFlushing || m_pendingUpdates; });
+        } else if (!m_flushRequested.wait_until(lck, m_flushDeadline, [this]() { return m_stopFlushing || !m_pendingUpdates; })) {
+            publishNow();
         }
     }
+}
 
-    return changed;
+/** @brief Body of the thread which publishes the summary updates of damped alarms once per summary interval */
+void Daemon::summarizeDampedAlarms()
+{
+    std::unique_lock lck{m_summaryMtx};
+    while (!m_stopSummaries) {
+        if (!m_engine.hasDampedAlarms()) {
+            m_summaryRequested.wait(lck, [this]() { return m_stopSummaries || m_engine.hasDampedAlarms(); });
+            continue;
+        }
+        if (m_summaryRequested.wait_for(lck, m_engine.flapDamping()->summaryInterval, [this]() { return m_stopSummaries; })) {
+            break;
+        }
+
+        // lock ordering: the engine calls back into alarmUpdated() which might lock m_summaryMtx
+        lck.unlock();
+        if (const auto updates = m_engine.summarizeDampedAlarms(TimePoint::clock::now())) {
+            std::unique_lock publishLck{m_mtx};
+            publishAlarms(updates);
+        }
+        lck.lock();
+    }
 }
 
 sysrepo::ErrorCode Daemon::submitAlarm(sysrepo::Session rpcSession, const libyang::DataNode& input)
 {
     WITH_TIME_MEASUREMENT{};
     const auto now = TimePoint::clock::now();
-    const auto& alarmKey = InstanceKey::fromNode(input);
-    const auto severity = std::get<libyang::Enum>(input.findPath("severity").value().asTerm().value()).value;
-    const bool isClearedNow = severity == ClearedSeverity;
+    auto alarmKey = InstanceKey::fromNode(input);
     m_log->trace("RPC {}: {}", rpcPrefix, *input.printStr(libyang::DataFormat::JSON, libyang::PrintFlags::Shrink));
 
-    std::string keyXPath;
-    try {
-        keyXPath = alarmKey.xpathIndex();
-    } catch (std::logic_error& e) {
-        rpcSession.setErrorMessage(e.what());
-        return sysrepo::ErrorCode::InvalidArgument;
-    }
+    alarmKey.type.identity = resolveIdentity(alarmKey.type.id);
+    auto res = updateAlarm(now, alarmKey, input);
 
-    std::unique_lock lck{m_mtx};
-    if (m_inventoryDirty) {
-        WITH_TIME_MEASUREMENT{"submitAlarm/rebuildInventory"};
-        const auto alarmRoot = m_session.getData(rootPath);
-        assert(alarmRoot);
-        rebuildInventory(*alarmRoot);
-    }
-    if (auto inventoryError = inventoryValidationError(alarmKey, severity)) {
+    if (res.errorCode != sysrepo::ErrorCode::Ok) {
         rpcSession.setNetconfError({.type = "application",
                                     .tag = "data-missing",
                                     .appTag = std::nullopt,
                                     .path = std::nullopt,
-                                    .message = (inventoryError.value() + " -- see RFC8632 (sec. 4.1).").c_str(),
+                                    .message = res.errorMessage.c_str(),
                                     .infoElements = {}});
-        m_log->warn(inventoryError.value());
-        return sysrepo::ErrorCode::OperationFailed;
+        return res.errorCode;
     }
 
-    if (auto it = m_alarms.find(alarmKey); isClearedNow && ((it == m_alarms.end()) || ((it != m_alarms.end()) && it->second.isCleared))) {
-        m_log->trace("No update for already-cleared alarm {}", keyXPath);
-        return sysrepo::ErrorCode::Ok;
+    if (res.changed) {
+        std::unique_lock lck{m_mtx};
+        publishAlarms(1);
     }
+    m_engine.snapshotWhenDue();
+    return sysrepo::ErrorCode::Ok;
+}
 
-    auto matchedShelf = shouldBeShelved(*m_shelvingRules, alarmKey);
-    auto alarmNodePath = (matchedShelf ? shelvedAlarmListInstances : alarmListInstances) + keyXPath;
-    m_edit->newPath(alarmNodePath, std::nullopt, libyang::CreationOptions::Update);
-    auto [it, wasInserted] = m_alarms.try_emplace(alarmKey);
-    auto res = it->second.updateByRpc(!wasInserted, now, input, matchedShelf, m_notifyStatusChanges, m_notifySeverityThreshold, m_maxAlarmStatusChanges);
+/** @short Process a batch of alarm updates in the order of their index, publishing the result just once
+ *
+ * Invalid entries do not fail the whole RPC. Instead, each of them is reported as rejected in the output.
+ * The entries are timestamped one nanosecond apart, so that several updates of the same alarm still result
+ * in status-change entries with distinct keys.
+ */
+sysrepo::ErrorCode Daemon::submitAlarms(const libyang::DataNode& input, libyang::DataNode output)
+{
+    WITH_TIME_MEASUREMENT{};
+    auto time = TimePoint::clock::now();
+    m_log->trace("RPC {}: {}", batchRpcPrefix, *input.printStr(libyang::DataFormat::JSON, libyang::PrintFlags::Shrink));
 
-    if (res.changed) {
-        m_edit->newPath(alarmNodePath + "/is-cleared", it->second.isCleared ? "true" : "false", libyang::CreationOptions::Update);
-        m_edit->newPath(alarmNodePath + "/last-raised", yangTimeFormat(it->second.lastRaised), libyang::CreationOptions::Update);
-        m_edit->newPath(alarmNodePath + "/last-changed", yangTimeFormat(it->second.lastChanged), libyang::CreationOptions::Update);
-        m_edit->newPath(alarmNodePath + "/perceived-severity", Severities[it->second.lastSeverity], libyang::CreationOptions::Update);
-        m_edit->newPath(alarmNodePath + "/alarm-text", it->second.text, libyang::CreationOptions::Update);
-        if (it->second.shelf) {
-            m_edit->newPath(alarmNodePath + "/shelf-name", *it->second.shelf, libyang::CreationOptions::Update);
+    std::vector<std::pair<uint32_t, libyang::DataNode>> entries;
+    for (const auto& entry : input.findXPath("alarm")) {
+        entries.emplace_back(std::get<uint32_t>(entry.findPath("index")->asTerm().value()), entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    unsigned changed = 0;
+
+    for (const auto& [index, entry] : entries) {
+        auto alarmKey = InstanceKey::fromNode(entry);
+        alarmKey.type.identity = resolveIdentity(alarmKey.type.id);
+        auto res = updateAlarm(time, alarmKey, entry);
+        time += std::chrono::nanoseconds{1};
+        changed += res.changed;
+
+        auto result = utils::newListInstance(output, "alarm", {std::to_string(index)}, true);
+        result.newPath("resource", alarmKey.resource, libyang::CreationOptions::Output);
+        result.newPath("alarm-type-id", alarmKey.type.id, libyang::CreationOptions::Output);
+        result.newPath("alarm-type-qualifier", alarmKey.type.qualifier, libyang::CreationOptions::Output);
+        if (res.errorCode == sysrepo::ErrorCode::Ok) {
+            result.newPath("result", "ok", libyang::CreationOptions::Output);
         } else {
-            m_edit->newPath(alarmNodePath + "/time-created", yangTimeFormat(it->second.created), libyang::CreationOptions::Update);
-        }
-
-        updateStatusChangeList(*m_edit, alarmNodePath, it->second, res.removedStatusChanges);
-
-        m_log->debug("Updated alarm: {}", *m_edit->printStr(libyang::DataFormat::JSON, libyang::PrintFlags::Shrink));
-        updateStatistics();
-        m_session.editBatch(*m_edit, sysrepo::DefaultOperation::Replace);
-        {
-            WITH_TIME_MEASUREMENT{"submitAlarm/applyChanges"};
-            m_session.applyChanges();
+            result.newPath("result", "rejected", libyang::CreationOptions::Output);
+            result.newPath("error-message", res.errorMessage, libyang::CreationOptions::Output);
         }
+    }
 
-        if (res.shouldNotify) {
-            WITH_TIME_MEASUREMENT{"submitAlarm/sendNotification"};
-            m_session.sendNotification(createStatusChangeNotification(m_edit->findPath(alarmNodePath).value()), sysrepo::Wait::No);
-        }
+    if (changed) {
+        std::unique_lock lck{m_mtx};
+        publishAlarms(changed);
     }
+    m_engine.snapshotWhenDue();
     return sysrepo::ErrorCode::Ok;
 }
 
-libyang::DataNode Daemon::createStatusChangeNotification(const libyang::DataNode& alarmNode)
+/** @brief Render the alarm-notification; this runs in the thread of the NotificationDispatcher */
+libyang::DataNode Daemon::createStatusChangeNotification(const StatusChangeNotification& data) const
 {
     static const std::string prefix = "/ietf-alarms:alarm-notification";
 
-    auto notification = m_session.getContext().newPath(prefix + "/resource", utils::childValue(alarmNode, "resource"), libyang::CreationOptions::Update);
-    notification.newPath(prefix + "/alarm-type-id", utils::childValue(alarmNode, "alarm-type-id"), libyang::CreationOptions::Update);
-    notification.newPath(prefix + "/time", utils::childValue(alarmNode, "last-changed"), libyang::CreationOptions::Update);
-    notification.newPath(prefix + "/alarm-text", utils::childValue(alarmNode, "alarm-text"), libyang::CreationOptions::Update);
+    auto notification = m_notificationSession.getContext().newPath(prefix + "/resource", data.key.resource, libyang::CreationOptions::Update);
+    notification.newPath(prefix + "/alarm-type-id", data.key.type.id, libyang::CreationOptions::Update);
+    notification.newPath(prefix + "/time", m_timeFormatter(data.time), libyang::CreationOptions::Update);
+    notification.newPath(prefix + "/alarm-text", data.text, libyang::CreationOptions::Update);
 
-    if (auto qualifier = utils::childValue(alarmNode, "alarm-type-qualifier"); !qualifier.empty()) {
-        notification.newPath(prefix + "/alarm-type-qualifier", qualifier, libyang::CreationOptions::Update);
+    if (!data.key.type.qualifier.empty()) {
+        notification.newPath(prefix + "/alarm-type-qualifier", data.key.type.qualifier, libyang::CreationOptions::Update);
     }
 
-    notification.newPath(prefix + "/perceived-severity", utils::childValue(alarmNode, "is-cleared") == "true" ? "cleared" : utils::childValue(alarmNode, "perceived-severity"), libyang::CreationOptions::Update);
+    notification.newPath(prefix + "/perceived-severity", Severities[data.perceivedSeverity], libyang::CreationOptions::Update);
 
     return notification;
 }
@@ -490,37 +1091,12 @@ sysrepo::ErrorCode Daemon::purgeAlarms(const std::string& rpcPath, const libyang
     WITH_TIME_MEASUREMENT{};
     const auto now = std::chrono::system_clock::now();
     bool doingShelved = rpcPath == purgeShelvedRpcPrefix;
-    PurgeFilter filter(rpcInput);
-    uint32_t purgedAlarms = 0;
-
-    std::unique_lock lck{m_mtx};
-
-    for (auto it = m_alarms.begin(); it != m_alarms.end(); /* nothing */) {
-        const auto& [index, entry] = *it;
-        if (doingShelved != !!entry.shelf) {
-            // when purging through the "shelved" RPC, only consider shelved list and vice verse
-            ++it;
-            continue;
-        }
-        if (!filter.matches(index, entry)) {
-            ++it;
-            continue;
-        }
-        ++purgedAlarms;
-        m_edit->findPath((doingShelved ? shelvedAlarmListInstances : alarmListInstances) + index.xpathIndex())->unlink();
-        it = m_alarms.erase(it);
-    }
+    const auto purgedAlarms = m_engine.purge(PurgeFilter{rpcInput}, doingShelved, now);
 
     if (purgedAlarms) {
-        if (doingShelved) {
-            m_shelfListLastChanged = now;
-        } else {
-            m_alarmListLastChanged = now;
-        }
-        updateStatistics();
+        std::unique_lock lck{m_mtx};
         m_log->trace("purgeAlarms: removing entries in sysrepo");
-        m_session.editBatch(*m_edit, sysrepo::DefaultOperation::Replace);
-        m_session.applyChanges();
+        publishNow();
     }
 
     output.newPath(rpcPath + "/purged-alarms", std::to_string(purgedAlarms), libyang::CreationOptions::Output);
@@ -532,30 +1108,11 @@ sysrepo::ErrorCode Daemon::compressAlarms(const std::string& rpcPath, const liby
     WITH_TIME_MEASUREMENT{};
 
     bool doingShelved = rpcPath == compressShelvedAlarmsRpcPrefix;
-    CompressFilter filter(rpcInput);
-    uint32_t compressedAlarmEntries = 0;
-
-    std::unique_lock lck{m_mtx};
-
-    for (auto& [key, alarm] : m_alarms) {
-        if (doingShelved == !!alarm.shelf && filter.matches(key, alarm)) {
-            auto discardTimestamps = alarm.shrinkStatusChanges(1);
-
-            if (!discardTimestamps.empty()) {
-                ++compressedAlarmEntries;
-            }
-
-            for (const auto& time : discardTimestamps) {
-                const auto& prefix = (doingShelved ? shelvedAlarmListInstances : alarmListInstances);
-                const auto xpath = statusChangeXPath(prefix + key.xpathIndex(), time);
-                m_edit->findPath(xpath)->unlink();
-            }
-        }
-    }
+    const auto compressedAlarmEntries = m_engine.compress(CompressFilter{rpcInput}, doingShelved);
 
     if (compressedAlarmEntries) {
-        m_session.editBatch(*m_edit, sysrepo::DefaultOperation::Replace);
-        m_session.applyChanges();
+        std::unique_lock lck{m_mtx};
+        publishNow();
     }
 
     output.newPath(rpcPath + "/compressed-alarms", std::to_string(compressedAlarmEntries), libyang::CreationOptions::Output);
@@ -563,169 +1120,199 @@ sysrepo::ErrorCode Daemon::compressAlarms(const std::string& rpcPath, const liby
 }
 
 namespace {
-
-/** @brief Copy contents of shared leaves from existing alarm node into edit. */
-void createCommonAlarmNodeProps(libyang::DataNode& edit, const libyang::DataNode& alarm, const std::string& prefix)
-{
-    for (const auto& leafName : {"is-cleared", "last-raised", "last-changed", "perceived-severity", "alarm-text"}) {
-        edit.newPath(prefix + "/" + leafName, utils::childValue(alarm, leafName), libyang::CreationOptions::Update);
-    }
-
-    for (const auto& statusChange : alarm.findXPath("status-change")) {
-        const auto time = utils::childValue(statusChange, "time");
-        edit.newPath(prefix + "/status-change[time='" + time + "']/perceived-severity", utils::childValue(statusChange, "perceived-severity"));
-        edit.newPath(prefix + "/status-change[time='" + time + "']/alarm-text", utils::childValue(statusChange, "alarm-text"));
-    }
-}
-
-/** @brief Creates an edit with shelved-alarm list node based on existing alarm node */
-void createShelvedAlarmNodeFromExistingNode(libyang::DataNode& edit, const libyang::DataNode& alarm, const InstanceKey& alarmKey, const std::string& shelfName)
+/** @brief Alarm type of an /ietf-alarms:alarms/alarm-inventory/alarm-type node */
+Type inventoryType(const libyang::DataNode& alarmTypeNode)
 {
-    const auto key = shelvedAlarmListInstances + alarmKey.xpathIndex();
-    edit.newPath(key + "/shelf-name", shelfName, libyang::CreationOptions::Update);
-    createCommonAlarmNodeProps(edit, alarm, key);
+    return {
+        .id = utils::childValue(alarmTypeNode, "alarm-type-id"),
+        .qualifier = utils::childValue(alarmTypeNode, "alarm-type-qualifier"),
+    };
 }
 
-/** @brief Creates an edit with alarm-list node based on existing alarm node */
-void createAlarmNodeFromExistingNode(libyang::DataNode& edit, const libyang::DataNode& alarm, const InstanceKey& alarmKey, const std::chrono::time_point<std::chrono::system_clock>& now)
+/** @brief Allowed resources and severities from an /ietf-alarms:alarms/alarm-inventory/alarm-type node */
+Daemon::InventoryData inventoryData(const libyang::DataNode& alarmTypeNode)
 {
-    const auto key = alarmListInstances + alarmKey.xpathIndex();
-    edit.newPath(key + "/time-created", yangTimeFormat(now), libyang::CreationOptions::Update);
-    createCommonAlarmNodeProps(edit, alarm, key);
+    Daemon::InventoryData res;
+    for (const auto& child : alarmTypeNode.immediateChildren()) {
+        const auto shortName = child.schema().name();
+        if (shortName == "resource") {
+            res.resources.emplace(child.asTerm().valueStr());
+        } else if (shortName == "severity-level") {
+            res.severities.emplace(std::get<libyang::Enum>(child.asTerm().value()).value);
+        }
+    }
+    return res;
 }
 }
 
-bool Daemon::reshelve(sysrepo::Session running)
+/** @short Propagate a change of the alarm-inventory into a new snapshot of the cached inventory
+ *
+ * Small changes are applied to a copy of the current snapshot right away. When that would be too expensive, the whole
+ * inventory is rebuilt by a background thread instead. Until the new snapshot is published, alarms are validated
+ * against the previous one.
+ * */
+void Daemon::inventoryChanged(sysrepo::Session session, const sysrepo::Event event)
 {
-    WITH_TIME_MEASUREMENT{};
-    assert(running.activeDatastore() == sysrepo::Datastore::Running);
-
-    auto now = std::chrono::system_clock::now();
-    std::vector<std::string> toErase;
-    bool change = false;
-    m_shelvingRules = running.getData(ctrlShelving);
-    assert(m_shelvingRules);
-
-    for (const auto& [alarmKey, alarm] : m_alarms) {
-        const auto& shelf = shouldBeShelved(*m_shelvingRules, alarmKey);
-        const auto& pathShelved = shelvedAlarmListInstances + alarmKey.xpathIndex();
-        const auto& pathUnshelved = alarmListInstances + alarmKey.xpathIndex();
-        if (alarm.shelf && !shelf) {
-            change = true;
-            auto node = *m_edit->findPath(pathShelved);
-            m_alarms[alarmKey].shelf = std::nullopt;
-            m_alarmListLastChanged = now;
-            m_shelfListLastChanged = now;
-            createAlarmNodeFromExistingNode(*m_edit, node, alarmKey, now);
-            node.unlink();
-            m_log->trace("Alarm {} moved from shelf", alarmKey.xpathIndex());
-        } else if (!alarm.shelf && shelf) {
-            change = true;
-            auto node = *m_edit->findPath(pathUnshelved);
-            m_alarms[alarmKey].shelf = shelf;
-            m_alarmListLastChanged = now;
-            m_shelfListLastChanged = now;
-            createShelvedAlarmNodeFromExistingNode(*m_edit, node, alarmKey, *shelf);
-            node.unlink();
-            m_log->trace("Alarm {} shelved ({})", alarmKey.xpathIndex(), *shelf);
-        } else if (alarm.shelf && shelf && *alarm.shelf != *shelf) {
-            change = true;
-            m_alarms[alarmKey].shelf = shelf;
-            m_shelfListLastChanged = now;
-            m_edit->newPath(pathShelved + "/shelf-name", *shelf, libyang::CreationOptions::Update);
-            m_log->trace("Alarm {} moved between shelfs ({} -> {})", alarmKey.xpathIndex(), *alarm.shelf, *shelf);
-        }
-    }
-
-    if (change) {
-        m_log->trace("reshelve: updating stats");
-        updateStatistics();
+    std::unique_lock lck{m_inventoryMtx};
+    if (m_inventoryRebuildRequested || m_inventoryRebuildRunning) {
+        // the snapshot which is being built might have been read before this change
+        m_inventoryRebuildRequested = true;
+        m_inventoryRebuildNeeded.notify_one();
+        return;
     }
 
-    return change;
+    // the changes of the Enabled event describe the whole current content
+    auto inventory = event == sysrepo::Event::Enabled ? std::make_shared<Inventory>() : std::make_shared<Inventory>(*m_inventory.load());
+    if (applyInventoryChanges(session, *inventory)) {
+        m_inventory.store(std::move(inventory));
+    } else {
+        m_log->debug("Alarm inventory: too many changes, rebuilding from scratch");
+        m_inventoryRebuildRequested = true;
+        m_inventoryRebuildNeeded.notify_one();
+    }
 }
 
-void Daemon::rebuildInventory(const libyang::DataNode& dataWithInventory)
+/** @short Apply changes of the alarm-inventory to a copy of the cached inventory
+ *
+ * New alarm types, resources and severities are added right away. The resource and severity leaf-lists are state
+ * data which might contain duplicate values, so alarm types with removed resources or severities are re-read
+ * from sysrepo one by one. The data of the unchanged alarm types are shared with the previous snapshot.
+ *
+ * @return false if there were too many alarm types to re-read, and the inventory has to be rebuilt from scratch
+ * */
+bool Daemon::applyInventoryChanges(sysrepo::Session session, Inventory& inventory) const
 {
-    const auto data = dataWithInventory.findPath(alarmInventoryPrefix);
-    m_inventory.clear();
-    if (data->child()) {
-        for (const auto& entry : data->child()->siblings()) {
-            decltype(InventoryData::resources) resources;
-            decltype(InventoryData::severities) severities;
-            for (const auto& child : entry.immediateChildren()) {
-                const auto shortName = child.schema().name();
-                if (shortName == "resource") {
-                    resources.emplace(child.asTerm().valueStr());
-                } else if (shortName == "severity-level") {
-                    severities.emplace(std::get<libyang::Enum>(child.asTerm().value()).value);
-                }
+    constexpr auto maxReloadedTypes = 16;
+    std::map<std::string, Type> toReload; // XPath of the alarm type node -> its type
+    boost::unordered_flat_map<Type, std::shared_ptr<InventoryData>, boost::hash<Type>> modified; // private copies of the changed alarm types
+
+    auto modifiable = [&](const Inventory::iterator& it) -> InventoryData& {
+        auto [copy, inserted] = modified.try_emplace(it->first);
+        if (inserted) {
+            copy->second = std::make_shared<InventoryData>(*it->second);
+        }
+        return *copy->second;
+    };
+
+    for (const auto& change : session.getChanges(alarmInventoryPrefix + "//."s)) {
+        if (change.operation != sysrepo::ChangeOperation::Created && change.operation != sysrepo::ChangeOperation::Deleted) {
+            continue;
+        }
+        const bool created = change.operation == sysrepo::ChangeOperation::Created;
+        const auto name = change.node.schema().name();
+
+        if (name == "alarm-type") {
+            const auto type = inventoryType(change.node);
+            if (created) {
+                inventory.try_emplace(type, std::make_shared<const InventoryData>());
+            } else {
+                inventory.erase(type);
+                modified.erase(type);
+                toReload.erase(change.node.path());
+            }
+            continue;
+        }
+
+        if (name != "resource" && name != "severity-level") {
+            continue;
+        }
+        const auto alarmTypeNode = *change.node.parent();
+        auto it = inventory.find(inventoryType(alarmTypeNode));
+        if (it == inventory.end()) {
+            // the whole alarm type has been removed already
+            continue;
+        }
+        if (!created) {
+            toReload.emplace(alarmTypeNode.path(), it->first);
+            if (toReload.size() > maxReloadedTypes) {
+                return false;
             }
-            m_inventory.emplace(
-                Type{
-                    .id = utils::childValue(entry, "alarm-type-id"),
-                    .qualifier = utils::childValue(entry, "alarm-type-qualifier")},
-                InventoryData{
-                    .resources = resources,
-                    .severities = severities,
-                });
+        } else if (name == "resource") {
+            modifiable(it).resources.emplace(change.node.asTerm().valueStr());
+        } else {
+            modifiable(it).severities.emplace(std::get<libyang::Enum>(change.node.asTerm().value()).value);
         }
     }
-    m_inventoryDirty = false;
-}
 
-void Daemon::updateStatistics()
-{
-    struct PerSeveritySummary {
-        unsigned total;
-        unsigned cleared;
-    };
-    std::map<int32_t, PerSeveritySummary> summary;
-    int32_t totalList{0}, totalShelved{0};
-
-    // make sure that all severities are present *and* initialize counters to zero
-    for (unsigned i = 2 /* #0: dummy, #1: cleared, #2: the first real one */; i < Severities.size(); ++i) {
-        summary[i] = PerSeveritySummary{
-            .total = 0,
-            .cleared = 0,
-        };
+    for (auto& [type, data] : modified) {
+        inventory[type] = std::move(data);
     }
 
-    for (const auto& [key, entry] : m_alarms) {
-        if (entry.shelf) {
-            // shelved alarms do not affect the alarm-summary
-            ++totalShelved;
-            if (entry.lastChanged >= m_shelfListLastChanged) {
-                m_shelfListLastChanged = entry.lastChanged;
-            }
-            continue;
+    for (const auto& [xpath, type] : toReload) {
+        auto data = session.getData(xpath);
+        auto alarmTypeNode = data ? data->findPath(xpath) : std::nullopt;
+        if (alarmTypeNode) {
+            inventory[type] = std::make_shared<const InventoryData>(inventoryData(*alarmTypeNode));
+        } else {
+            inventory.erase(type);
         }
+    }
 
-        ++totalList;
-        ++summary[entry.lastSeverity].total;
-        if (entry.isCleared) {
-            ++summary[entry.lastSeverity].cleared;
+    return true;
+}
+
+/** @short Build a fresh snapshot of the inventory whenever a full rebuild is requested, and publish it once it's complete */
+void Daemon::rebuildInventoryWhenRequested()
+{
+    auto session = m_connection.sessionStart(sysrepo::Datastore::Operational);
+    std::unique_lock lck{m_inventoryMtx};
+    while (true) {
+        m_inventoryRebuildNeeded.wait(lck, [this]() { return m_stopInventoryRebuilds || m_inventoryRebuildRequested; });
+        if (m_stopInventoryRebuilds) {
+            return;
         }
-        if (entry.lastChanged >= m_alarmListLastChanged) {
-            m_alarmListLastChanged = entry.lastChanged;
+        m_inventoryRebuildRequested = false;
+        m_inventoryRebuildRunning = true;
+        lck.unlock();
+
+        auto inventory = std::make_shared<Inventory>();
+        {
+            WITH_TIME_MEASUREMENT{"rebuildInventory"};
+            if (auto data = session.getData(alarmInventoryPrefix)) {
+                for (const auto& alarmTypeNode : data->findXPath(alarmInventoryPrefix + "/alarm-type"s)) {
+                    (*inventory)[inventoryType(alarmTypeNode)] = std::make_shared<const InventoryData>(inventoryData(alarmTypeNode));
+                }
+            }
         }
+
+        lck.lock();
+        m_inventory.store(std::move(inventory));
+        m_inventoryRebuildRunning = false;
     }
+}
 
-    for (const auto& [severity, summ] : summary) {
+/** @short XPaths and values of all leaves of the alarm summary and of the list statistics */
+std::vector<std::pair<std::string, std::string>> Daemon::statisticsLeaves() const
+{
+    std::vector<std::pair<std::string, std::string>> res;
+    const auto statistics = m_engine.statistics();
+    for (unsigned severity = 2 /* #0: dummy, #1: cleared, #2: the first real one */; severity < Severities.size(); ++severity) {
+        const auto total = statistics.perSeverity[severity].total;
+        const auto cleared = statistics.perSeverity[severity].cleared;
         const auto prefix = alarmSummaryPrefix + "/alarm-summary[severity='"s + Severities[severity] + "']";
-        m_edit->newPath(prefix + "/total", std::to_string(summ.total), libyang::CreationOptions::Update);
-        m_edit->newPath(prefix + "/not-cleared", std::to_string(summ.total - summ.cleared), libyang::CreationOptions::Update);
-        m_edit->newPath(prefix + "/cleared", std::to_string(summ.cleared), libyang::CreationOptions::Update);
+        res.emplace_back(prefix + "/total", std::to_string(total));
+        res.emplace_back(prefix + "/not-cleared", std::to_string(total - cleared));
+        res.emplace_back(prefix + "/cleared", std::to_string(cleared));
     }
 
-    m_edit->newPath(alarmList + "/number-of-alarms", std::to_string(totalList), libyang::CreationOptions::Update);
-    m_edit->newPath(alarmList + "/last-changed", yangTimeFormat(m_alarmListLastChanged), libyang::CreationOptions::Update);
-    m_edit->newPath(shelvedAlarmList + "/number-of-shelved-alarms", std::to_string(totalShelved), libyang::CreationOptions::Update);
-    m_edit->newPath(shelvedAlarmList + "/shelved-alarms-last-changed", yangTimeFormat(m_shelfListLastChanged), libyang::CreationOptions::Update);
+    res.emplace_back(alarmList + "/number-of-alarms", std::to_string(statistics.alarms));
+    res.emplace_back(alarmList + "/last-changed", m_timeFormatter(m_engine.alarmListLastChanged()));
+    res.emplace_back(shelvedAlarmList + "/number-of-shelved-alarms", std::to_string(statistics.shelvedAlarms));
+    res.emplace_back(shelvedAlarmList + "/shelved-alarms-last-changed", m_timeFormatter(m_engine.shelfListLastChanged()));
+    return res;
 }
 
-std::string statusChangeXPath(const std::string& alarmNodePath, const TimePoint& time)
+/** @brief Propagate those statistics leaves which have changed since the last time into m_edit */
+void Daemon::updateStatistics()
 {
-    return alarmNodePath + "/status-change[time='" + yangTimeFormat(time) + "']";
+    for (auto& [path, value] : statisticsLeaves()) {
+        auto [it, inserted] = m_publishedStatistics.try_emplace(path);
+        if (!inserted && it->second == value) {
+            continue;
+        }
+        m_edit->newPath(path, value, libyang::CreationOptions::Update);
+        m_unpublished.statisticsLeaves.insert(path);
+        it->second = std::move(value);
+    }
 }
 }
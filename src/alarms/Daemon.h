@@ -1,53 +1,209 @@
 #pragma once
+#include <atomic>
+#include <boost/unordered/unordered_flat_map.hpp>
+#include <boost/unordered/unordered_flat_set.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <memory>
 #include <optional>
 #include <mutex>
+#include <thread>
 #include <sysrepo-cpp/Connection.hpp>
-#include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include "AlarmEngine.h"
 #include "AlarmEntry.h"
+#include "FlapDamping.h"
 #include "Key.h"
+#include "NotificationDispatcher.h"
 #include "utils/log-fwd.h"
+#include "utils/time.h"
 
 namespace alarms {
 
-class Daemon {
-public:
-    Daemon();
-    ~Daemon();
+/** @short Settings of the write-behind mode in which several alarm updates are published to sysrepo at once */
+struct WriteBehind {
+    std::chrono::milliseconds window; /**< For how long can an alarm update wait before it gets published */
+    unsigned maxPendingUpdates; /**< Publish right away once this many alarm updates are waiting */
+};
+
+/** @short How do the alarm lists and the alarm summary get into the operational datastore */
+enum class Publishing {
+    Push, /**< Each change is pushed to sysrepo right away (or via the write-behind) */
+    OnDemand, /**< Nothing is pushed; the data are rendered from the cache whenever a client asks for them */
+};
 
-    // FIXME: consider boost::concurrent_flat_set (Boost 1.84+) or boost::unordered_flat_set (Boost 1.81+) everywhere
+/** @short Publishes the alarms of an AlarmEngine to sysrepo, and feeds it with the RPCs and the configuration from sysrepo */
+class Daemon : private AlarmEngine::Events {
+public:
+    Daemon(const std::optional<WriteBehind>& writeBehind = std::nullopt, const Publishing publishing = Publishing::Push, const utils::TimeZone timeZone = utils::TimeZone::Local, const std::optional<FlapDamping>& flapDamping = std::nullopt, const std::optional<std::filesystem::path>& stateDirectory = std::nullopt);
+    ~Daemon() override;
 
     struct InventoryData {
-        std::unordered_set<std::string, boost::hash<std::string>> resources;
+        boost::unordered_flat_set<std::string, boost::hash<std::string>> resources;
         std::set<int32_t> severities;
     };
+    /** @short Alarm types which are allowed by the alarm-inventory; an immutable snapshot once published */
+    using Inventory = boost::unordered_flat_map<Type, std::shared_ptr<const InventoryData>, boost::hash<Type>>;
 
 private:
     sysrepo::Connection m_connection;
     sysrepo::Session m_session;
+    sysrepo::Session m_notificationSession; /**< Only used from the thread of m_notifications */
     alarms::Log m_log;
-    std::mutex m_mtx;
-    NotifyStatusChanges m_notifyStatusChanges;
-    std::optional<int32_t> m_notifySeverityThreshold;
-    std::optional<uint16_t> m_maxAlarmStatusChanges;
-    bool m_inventoryDirty;
-    std::unordered_map<Type, InventoryData, boost::hash<Type>> m_inventory;
-    std::unordered_map<InstanceKey, AlarmEntry, boost::hash<InstanceKey>> m_alarms;
-    TimePoint m_alarmListLastChanged, m_shelfListLastChanged;
-    std::optional<libyang::DataNode> m_shelvingRules;
+    const utils::YangTimeFormatter m_timeFormatter;
+
+    /* Lock ordering: m_mtx, then the locks of m_engine, then the mutex of a PendingSlice or m_summaryMtx.
+     * The callbacks from m_engine only lock a PendingSlice (or m_summaryMtx), so the alarm updates from several threads
+     * only meet in m_engine, and they are rendered into m_edit by whoever publishes them next. */
+    std::mutex m_mtx; /**< Publishing: m_session, m_edit, m_unpublished and everything which is waiting to be published */
+
+    /** @short An alarm change reported by m_engine, to be rendered into m_edit once it gets published */
+    struct PendingChange {
+        enum class Kind {
+            Updated,
+            Removed,
+            StatusChangeRemoved,
+            Reshelved,
+        };
+        Kind kind;
+        InstanceKey key;
+        AlarmEntry alarm; /**< A copy of the alarm as of this change, without its status-change history */
+        bool newStatusChange; /**< Updated: the newest status change of the alarm is a new one */
+        std::optional<TimePoint> removedStatusChange; /**< Updated, StatusChangeRemoved: the status change which was dropped */
+        std::optional<std::string> previousShelf; /**< Reshelved */
+    };
+
+    /** @short Changes and notifications of alarms which hash into this slice, in the order in which they happened */
+    struct alignas(64) PendingSlice {
+        std::mutex mtx;
+        std::vector<PendingChange> changes; /**< Only when pushing to sysrepo */
+        std::vector<std::pair<uint64_t, StatusChangeNotification>> notifications; /**< With their global sequence number */
+    };
+    std::vector<PendingSlice> m_pending;
+    std::atomic<uint64_t> m_notificationSequence;
+
+    std::atomic<std::shared_ptr<const Inventory>> m_inventory; /**< Current snapshot, replaced as a whole on each change */
+    std::mutex m_inventoryMtx; /**< Serializes the writers of m_inventory, readers do not lock anything */
+    bool m_inventoryRebuildRequested;
+    bool m_inventoryRebuildRunning;
+    bool m_stopInventoryRebuilds;
+    std::condition_variable m_inventoryRebuildNeeded;
+    std::thread m_inventoryRebuilder;
+    AlarmEngine m_engine;
+    std::map<std::string, std::string> m_publishedStatistics; /**< XPath -> value of the summary leaves in m_edit */
     std::optional<sysrepo::Subscription> m_alarmSub;
+    std::optional<sysrepo::Subscription> m_batchSub; /**< A subscription of its own, so that the batches do not hold up single alarm updates */
+    std::optional<sysrepo::Subscription> m_maintenanceSub; /**< Purging and compressing */
+    std::optional<sysrepo::Subscription> m_controlSub;
     std::optional<sysrepo::Subscription> m_inventorySub;
-    std::optional<libyang::DataNode> m_edit;
+    std::optional<sysrepo::Subscription> m_operSub;
+    std::optional<libyang::DataNode> m_edit; /**< What was pushed to sysrepo; unused when publishing on demand */
+
+    /** @short Nodes of a single alarm within m_edit, so that updating the alarm does not have to look them up
+     *
+     * Each alarm in m_edit has its entry in m_alarmNodes; nodes of alarms are never looked up by their path.
+     * */
+    struct AlarmNodes {
+        libyang::DataNode alarm;
+        libyang::DataNodeTerm isCleared;
+        libyang::DataNodeTerm lastRaised;
+        libyang::DataNodeTerm lastChanged;
+        libyang::DataNodeTerm perceivedSeverity;
+        libyang::DataNodeTerm alarmText;
+        std::optional<libyang::DataNode> flapping; /**< Only present while the alarm is damped */
+        std::deque<libyang::DataNode> statusChanges; /**< In the same order as AlarmEntry::statusChanges, i.e., the oldest one first */
+    };
+    boost::unordered_flat_map<InstanceKey, AlarmNodes, boost::hash<InstanceKey>> m_alarmNodes; /**< Protected by m_mtx, just like m_edit */
+
+    /** @short Changes in m_edit which were not published to sysrepo yet */
+    struct UnpublishedChanges {
+        using Alarm = std::pair<InstanceKey, bool>; /**< An alarm, and whether it is in the shelved-alarms list */
+
+        /** @short Leaves of an alarm which are published on their own when they change */
+        enum Leaf : uint8_t {
+            IsCleared = 1 << 0,
+            LastRaised = 1 << 1,
+            LastChanged = 1 << 2,
+            PerceivedSeverity = 1 << 3,
+            AlarmText = 1 << 4,
+            Flapping = 1 << 5,
+            ShelfName = 1 << 6,
+        };
+
+        /** @short What has changed in a single alarm node */
+        struct AlarmChanges {
+            bool whole = false; /**< A new node (or one which moved to the other list), to be published along with all its children */
+            uint8_t leaves = 0; /**< The Leaf values which have changed */
+            size_t newStatusChanges = 0; /**< How many of the newest status-change entries are new */
+            std::vector<std::string> removedStatusChanges; /**< Times of the status-change entries which have to be removed */
+        };
+
+        boost::unordered_flat_map<Alarm, AlarmChanges, boost::hash<Alarm>> alarms;
+        boost::unordered_flat_set<Alarm, boost::hash<Alarm>> removedAlarms; /**< Alarm nodes which have to be removed */
+        std::unordered_set<std::string> statisticsLeaves; /**< Leaves of the summary and of the list statistics which have changed */
+
+        void alarmAdded(const Alarm& alarm);
+        void leavesChanged(const Alarm& alarm, const uint8_t leaves);
+        void statusChangeAdded(const Alarm& alarm);
+        void alarmRemoved(const Alarm& alarm);
+        void statusChangeRemoved(const Alarm& alarm, const std::string& time, const size_t statusChanges);
+        bool empty() const;
+    };
+    UnpublishedChanges m_unpublished;
+    std::optional<WriteBehind> m_writeBehind;
+    unsigned m_pendingUpdates;
+    std::chrono::steady_clock::time_point m_flushDeadline;
+    bool m_stopFlushing;
+    std::condition_variable m_flushRequested;
+    std::thread m_flusher;
+    std::mutex m_summaryMtx; /**< Protects m_stopSummaries, and lets the engine callbacks wake up m_summarizer */
+    bool m_stopSummaries;
+    std::condition_variable m_summaryRequested;
+    std::thread m_summarizer;
+
+    /** @short Outcome of a single alarm update */
+    struct AlarmUpdate {
+        sysrepo::ErrorCode errorCode; /**< Anything but ErrorCode::Ok means that the alarm-inventory rejected the update */
+        std::string errorMessage;
+        bool changed;
+    };
 
     sysrepo::ErrorCode submitAlarm(sysrepo::Session rpcSession, const libyang::DataNode& input);
+    sysrepo::ErrorCode submitAlarms(const libyang::DataNode& input, libyang::DataNode output);
+    AlarmUpdate updateAlarm(const TimePoint now, const InstanceKey& alarmKey, const libyang::DataNode& input);
+    std::optional<IdentityTable::Index> resolveIdentity(const std::string& alarmTypeId);
+    void publishAlarms(const unsigned updates);
+    void publishNow();
+    PendingSlice& pendingSlice(const InstanceKey& alarmKey);
+    void renderPendingChange(const PendingChange& change);
+    libyang::DataNode unpublishedChangesEdit();
+    void flushWhenDue();
+    void summarizeDampedAlarms();
+    void alarmUpdated(const InstanceKey& alarmKey, const AlarmEntry& alarm, const AlarmEngine::AlarmChange& change) override;
+    void alarmRemoved(const InstanceKey& alarmKey, const AlarmEntry& alarm) override;
+    void statusChangeRemoved(const InstanceKey& alarmKey, const AlarmEntry& alarm, const TimePoint& time) override;
+    void alarmReshelved(const InstanceKey& alarmKey, const AlarmEntry& alarm, const std::optional<std::string>& previousShelf) override;
+    void renderAlarmUpdate(const InstanceKey& alarmKey, const AlarmEntry& alarm, const bool newStatusChange, const std::optional<TimePoint>& removedStatusChange);
     sysrepo::ErrorCode purgeAlarms(const std::string& rpcPath, const libyang::DataNode& rpcInput, libyang::DataNode output);
     sysrepo::ErrorCode compressAlarms(const std::string& rpcPath, const libyang::DataNode& rpcInput, libyang::DataNode output);
-    libyang::DataNode createStatusChangeNotification(const libyang::DataNode& alarmNode);
-    std::optional<std::string> inventoryValidationError(const InstanceKey& key, const int32_t severity);
-    bool reshelve(sysrepo::Session running);
-    bool shrinkStatusChangesLists();
-    void rebuildInventory(const libyang::DataNode& dataWithInventory);
+    sysrepo::ErrorCode provideOperationalData(const std::string& subtree, const std::optional<std::string_view>& requestXPath, std::optional<libyang::DataNode>& output);
+    libyang::DataNode createStatusChangeNotification(const StatusChangeNotification& data) const;
+    std::optional<std::string> inventoryValidationError(const InstanceKey& key, const int32_t severity) const;
+    AlarmNodes& alarmNodes(const InstanceKey& alarmKey, const AlarmEntry& alarm);
+    void removeOldestStatusChange(const InstanceKey& alarmKey, const AlarmEntry& alarm, const TimePoint& time);
+    void moveAlarmNode(const InstanceKey& alarmKey, const AlarmEntry& alarm);
+    void inventoryChanged(sysrepo::Session session, const sysrepo::Event event);
+    bool applyInventoryChanges(sysrepo::Session session, Inventory& inventory) const;
+    void rebuildInventoryWhenRequested();
+    std::vector<std::pair<std::string, std::string>> statisticsLeaves() const;
     void updateStatistics();
+
+    NotificationDispatcher m_notifications; /**< The last member, so that its thread stops before anything it uses goes away */
 };
 
 }
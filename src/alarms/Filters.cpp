@@ -5,11 +5,11 @@
  *
  */
 
-#include <algorithm>
 #include <chrono>
 #include <libyang-cpp/DataNode.hpp>
 #include <libyang-cpp/Value.hpp>
 #include "AlarmEntry.h"
+#include "AlarmShards.h"
 #include "Filters.h"
 #include "utils/libyang.h"
 
@@ -23,45 +23,43 @@ T getValue(const libyang::DataNode& node)
 }
 namespace alarms {
 
-bool AlarmFilter::matches(const InstanceKey& alarmKey, const AlarmEntry& alarmEntry) const
+/** @brief The conditions which the AlarmTable can use for looking up the candidates, for one of the alarm lists */
+AlarmQuery AlarmFilter::query(const bool shelved) const
 {
-    return std::all_of(m_filters.begin(), m_filters.end(), [&](const auto& filter) { return filter(alarmKey, alarmEntry); });
+    return {
+        .shelved = shelved,
+        .isCleared = m_clearance == Clearance::Any ? std::nullopt : std::optional<bool>{m_clearance == Clearance::Cleared},
+        .minSeverity = m_minSeverity,
+        .maxSeverity = m_maxSeverity,
+        .changedBefore = m_changedBefore,
+        .resource = m_resource,
+        .typeId = m_typeId,
+    };
 }
 
 PurgeFilter::PurgeFilter(const libyang::DataNode& filterInput)
 {
     auto clearanceStatus = utils::childValue(filterInput, "alarm-clearance-status");
-    m_filters.emplace_back([clearanceStatus](const InstanceKey&, const AlarmEntry& alarm) {
-        if (clearanceStatus == "any") {
-            return true;
-        } else if (clearanceStatus == "cleared") {
-            return alarm.isCleared;
-        } else if (clearanceStatus == "not-cleared") {
-            return !alarm.isCleared;
-        } else {
-            throw std::logic_error("purge: Invalid alarm-clearance-status value");
-        }
-    });
+    if (clearanceStatus == "any") {
+        m_clearance = Clearance::Any;
+    } else if (clearanceStatus == "cleared") {
+        m_clearance = Clearance::Cleared;
+    } else if (clearanceStatus == "not-cleared") {
+        m_clearance = Clearance::NotCleared;
+    } else {
+        throw std::logic_error("purge: Invalid alarm-clearance-status value");
+    }
 
     if (auto severityContainer = filterInput.findPath("severity")) {
-        std::function<bool(int32_t)> severityCheck;
-
         if (auto choice = severityContainer->findPath("above")) {
-            auto sev = std::get<libyang::Enum>(choice->asTerm().value()).value;
-            severityCheck = [sev](int32_t alarmValue) { return sev < alarmValue; };
+            m_minSeverity = std::get<libyang::Enum>(choice->asTerm().value()).value + 1;
         } else if (auto choice = severityContainer->findPath("is")) {
-            auto sev = std::get<libyang::Enum>(choice->asTerm().value()).value;
-            severityCheck = [sev](int32_t alarmValue) { return sev == alarmValue; };
+            m_minSeverity = m_maxSeverity = std::get<libyang::Enum>(choice->asTerm().value()).value;
         } else if (auto choice = severityContainer->findPath("below")) {
-            auto sev = std::get<libyang::Enum>(choice->asTerm().value()).value;
-            severityCheck = [sev](int32_t alarmValue) { return sev > alarmValue; };
+            m_maxSeverity = std::get<libyang::Enum>(choice->asTerm().value()).value - 1;
         } else {
             throw std::logic_error("purge: Invalid choice value below severity");
         }
-
-        m_filters.emplace_back([severityCheck](const InstanceKey&, const AlarmEntry& alarm) {
-            return severityCheck(alarm.lastSeverity);
-        });
     }
 
     if (auto olderThanContainer = filterInput.findPath("older-than")) {
@@ -80,37 +78,25 @@ PurgeFilter::PurgeFilter(const libyang::DataNode& filterInput)
         } else {
             throw std::logic_error("purge: Invalid choice value below older-than");
         }
-
-        m_filters.emplace_back([threshold](const InstanceKey&, const AlarmEntry& alarm) {
-            return alarm.lastChanged < threshold;
-        });
+        m_changedBefore = threshold;
     }
 }
 
 CompressFilter::CompressFilter(const libyang::DataNode& filterInput)
 {
     if (auto resourceNode = filterInput.findPath("resource")) {
-        auto resource = resourceNode->asTerm().valueStr();
         /* FIXME:
          * for unshelved alarms, the type is resource-match, it is not enough to just compare the resource name, see https://github.com/CESNET/sysrepo-ietf-alarms/issues/2
          */
-        m_filters.emplace_back([resource](const InstanceKey& key, const AlarmEntry&) {
-            return key.resource == resource;
-        });
+        m_resource = resourceNode->asTerm().valueStr();
     }
 
     if (auto alarmTypeIdNode = filterInput.findPath("alarm-type-id")) {
-        auto alarmTypeId = alarmTypeIdNode->asTerm().valueStr();
-        m_filters.emplace_back([alarmTypeId](const InstanceKey& key, const AlarmEntry&) {
-            return key.type.id == alarmTypeId;
-        });
+        m_typeId = alarmTypeIdNode->asTerm().valueStr();
     }
 
     if (auto alarmTypeQualifierNode = filterInput.findPath("alarm-type-qualifier")) {
-        auto alarmTypeQualifier = alarmTypeQualifierNode->asTerm().valueStr();
-        m_filters.emplace_back([alarmTypeQualifier](const InstanceKey& key, const AlarmEntry&) {
-            return key.type.qualifier == alarmTypeQualifier;
-        });
+        m_typeQualifier = alarmTypeQualifierNode->asTerm().valueStr();
     }
 }
 }
@@ -6,7 +6,10 @@
  */
 
 #pragma once
-#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include "alarms/AlarmEntry.h"
 #include "alarms/Key.h"
 
 namespace libyang {
@@ -15,15 +18,43 @@ class DataNode;
 
 namespace alarms {
 
-struct AlarmEntry;
+struct AlarmQuery;
 
+/** @short Conditions on alarms, compiled from the input of an RPC into plain values
+ *
+ * Matching is a handful of comparisons without any allocations or indirect calls, so that it can run in a tight loop.
+ * */
 class AlarmFilter {
 public:
-    bool matches(const InstanceKey& key, const AlarmEntry& alarmNode) const;
+    enum class Clearance {
+        Any,
+        Cleared,
+        NotCleared,
+    };
+
+    bool matches(const InstanceKey& key, const AlarmEntry& alarm) const
+    {
+        return (m_clearance == Clearance::Any || alarm.isCleared == (m_clearance == Clearance::Cleared))
+            && alarm.lastSeverity >= m_minSeverity
+            && alarm.lastSeverity <= m_maxSeverity
+            && (!m_changedBefore || alarm.lastChanged < *m_changedBefore)
+            && (!m_resource || key.resource == *m_resource)
+            && (!m_typeId || key.type.id == *m_typeId)
+            && (!m_typeQualifier || key.type.qualifier == *m_typeQualifier);
+    }
+
+    AlarmFilter() = default; /**< Matches all alarms */
+
+    AlarmQuery query(const bool shelved) const;
 
 protected:
-    AlarmFilter() = default; // disable public instantiation of this class
-    std::vector<std::function<bool(const InstanceKey&, const AlarmEntry&)>> m_filters;
+    Clearance m_clearance = Clearance::Any;
+    int32_t m_minSeverity = std::numeric_limits<int32_t>::min();
+    int32_t m_maxSeverity = std::numeric_limits<int32_t>::max();
+    std::optional<TimePoint> m_changedBefore;
+    std::optional<std::string> m_resource;
+    std::optional<std::string> m_typeId;
+    std::optional<std::string> m_typeQualifier;
 };
 
 class PurgeFilter : public AlarmFilter {
@@ -37,4 +68,3 @@ public:
 };
 
 }
-
@@ -0,0 +1,46 @@
+#include <algorithm>
+#include <cmath>
+#include "FlapDamping.h"
+
+namespace alarms {
+
+/** @brief The penalty after it has been decaying since the last update */
+double FlapState::penaltyAt(const FlapDamping& settings, const TimePoint now) const
+{
+    // the wall clock might have been stepped back; the penalty does not grow because of that
+    const auto elapsed = std::max(std::chrono::duration<double>(now - updated), std::chrono::duration<double>::zero());
+    return penalty * std::exp2(-elapsed / std::chrono::duration<double>(settings.halfLife));
+}
+
+/** @brief Account for a single flap
+ *
+ * @return true if the alarm has just become damped
+ * */
+bool FlapState::flap(const FlapDamping& settings, const TimePoint now)
+{
+    penalty = std::min(penaltyAt(settings, now) + settings.flapPenalty, settings.maxPenalty);
+    updated = now;
+
+    if (!damped && penalty > settings.suppressThreshold) {
+        damped = true;
+        return true;
+    }
+    return false;
+}
+
+/** @brief Stop damping once the penalty has decayed enough
+ *
+ * @return true if a damped alarm has just been released
+ * */
+bool FlapState::release(const FlapDamping& settings, const TimePoint now)
+{
+    penalty = penaltyAt(settings, now);
+    updated = now;
+
+    if (damped && penalty < settings.reuseThreshold) {
+        damped = false;
+        return true;
+    }
+    return false;
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <chrono>
+#include "StatusChangeHistory.h"
+
+namespace alarms {
+
+/** @short Settings of flap damping which bounds how often an alarm that keeps flapping gets published
+ *
+ * This works just like the route flap damping of BGP (RFC 2439). Each flap of an alarm, i.e., each change between
+ * raised and cleared, adds a fixed penalty to that alarm. The penalty decays exponentially over time. Once it exceeds
+ * the suppress threshold, the alarm is damped. Updates of a damped alarm are not published one by one; they are
+ * collapsed into a single summary update per summaryInterval instead. The alarm is released once its penalty decays
+ * below the reuse threshold.
+ * */
+struct FlapDamping {
+    std::chrono::milliseconds halfLife; /**< After how long does the penalty decay to one half */
+    std::chrono::milliseconds summaryInterval; /**< How often are the held status changes and notifications of damped alarms published */
+    double flapPenalty = 1000;
+    double suppressThreshold = 3000;
+    double reuseThreshold = 750;
+    double maxPenalty = 12000; /**< Limits for how long an alarm stays damped once it stops flapping */
+};
+
+/** @short Flap penalty of a single alarm */
+struct FlapState {
+    double penalty = 0; /**< As of the last update */
+    TimePoint updated;
+    bool damped = false;
+    bool held = false; /**< A damped alarm has changed since its last summary update */
+
+    double penaltyAt(const FlapDamping& settings, const TimePoint now) const;
+    bool flap(const FlapDamping& settings, const TimePoint now);
+    bool release(const FlapDamping& settings, const TimePoint now);
+};
+}
@@ -0,0 +1,64 @@
+#include <libyang-cpp/Context.hpp>
+#include <libyang-cpp/Utils.hpp>
+#include <stdexcept>
+#include "Identities.h"
+
+namespace alarms {
+
+/** @brief Learn about identities from a (possibly changed) schema context
+ *
+ * @return true if any new identities were found
+ * */
+bool IdentityTable::update(const libyang::Context& ctx)
+{
+    const auto ietfAlarms = ctx.getModuleImplemented("ietf-alarms");
+    if (!ietfAlarms) {
+        throw std::runtime_error{"ietf-alarms is not implemented"};
+    }
+
+    std::optional<libyang::Identity> root;
+    for (const auto& identity : ietfAlarms->identities()) {
+        if (identity.name() == "alarm-type-id") {
+            root = identity;
+        }
+    }
+    if (!root) {
+        throw std::runtime_error{"ietf-alarms:alarm-type-id identity not found"};
+    }
+
+    auto identities = root->derivedRecursive();
+    identities.emplace_back(*root);
+
+    bool changed = false;
+    for (const auto& identity : identities) {
+        changed |= m_indexes.try_emplace(libyang::qualifiedName(identity), m_indexes.size()).second;
+    }
+    if (!changed) {
+        return false;
+    }
+
+    m_ancestors.assign(m_indexes.size(), boost::dynamic_bitset<>(m_indexes.size()));
+    for (const auto& base : identities) {
+        const auto baseIndex = m_indexes.at(libyang::qualifiedName(base));
+        m_ancestors[baseIndex].set(baseIndex);
+        for (const auto& derived : base.derivedRecursive()) {
+            m_ancestors[m_indexes.at(libyang::qualifiedName(derived))].set(baseIndex);
+        }
+    }
+    return true;
+}
+
+std::optional<IdentityTable::Index> IdentityTable::find(const std::string& qualifiedName) const
+{
+    if (auto it = m_indexes.find(qualifiedName); it != m_indexes.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+bool IdentityTable::isDerivedFrom(const Index identity, const Index base) const
+{
+    return m_ancestors[identity].test(base);
+}
+
+}
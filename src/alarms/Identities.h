@@ -0,0 +1,34 @@
+#pragma once
+#include <boost/container_hash/hash.hpp>
+#include <boost/dynamic_bitset.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace libyang {
+class Context;
+}
+
+namespace alarms {
+
+/** @short All identities derived from `ietf-alarms:alarm-type-id`, with precomputed derivation relations
+ *
+ * Each identity gets a small integer index, and "is derived from" becomes a single bit test. Indexes are stable;
+ * when the schema context changes and new identities appear, update() just appends them.
+ * */
+class IdentityTable {
+public:
+    using Index = uint32_t;
+
+    bool update(const libyang::Context& ctx);
+    std::optional<Index> find(const std::string& qualifiedName) const;
+    bool isDerivedFrom(const Index identity, const Index base) const;
+
+private:
+    std::unordered_map<std::string, Index, boost::hash<std::string>> m_indexes;
+    std::vector<boost::dynamic_bitset<>> m_ancestors; /**< For each identity, the set of identities which it is derived from (including itself) */
+};
+
+}
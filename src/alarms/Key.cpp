@@ -8,7 +8,8 @@ namespace {
 
 /** @brief Escapes key with the other type of quotes than found in the string.
  *
- *  @throws std::invalid_argument if both single and double quotes used in the input
+ * XPath literals cannot contain both kinds of quotes, so such a key is spelled as a concat() of its parts. That is only
+ * good for messages; libyang does not accept function calls in key predicates of paths.
  * */
 std::string escapeListKey(const std::string& str)
 {
@@ -16,7 +17,15 @@ std::string escapeListKey(const std::string& str)
     auto doubleQuotes = str.find('\"') != std::string::npos;
 
     if (singleQuotes && doubleQuotes) {
-        throw std::invalid_argument("Encountered mixed single and double quotes in XPath; can't properly escape.");
+        std::string res = "concat('";
+        for (const auto c : str) {
+            if (c == '\'') {
+                res += "', \"'\", '";
+            } else {
+                res += c;
+            }
+        }
+        return res + "')";
     } else if (singleQuotes) {
         return '\"' + str + '\"';
     } else {
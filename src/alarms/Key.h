@@ -7,7 +7,10 @@
 
 #pragma once
 #include <boost/container_hash/hash.hpp>
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <tuple>
 
 namespace libyang {
 class DataNode;
@@ -24,9 +27,17 @@ namespace alarms {
 struct Type {
     std::string id; /**< Static identity, `alarm-type-id` from RFC 8632 */
     std::string qualifier; /**< Dynamic qualifier, `alarm-type-qualifier` from RFC 8632 */
+    std::optional<uint32_t> identity = std::nullopt; /**< Index of `id` in the IdentityTable, if already resolved. Not a part of the type's identification. */
 
     std::string xpathIndex() const;
-    auto operator<=>(const Type& other) const = default;
+    bool operator==(const Type& other) const
+    {
+        return id == other.id && qualifier == other.qualifier;
+    }
+    auto operator<=>(const Type& other) const
+    {
+        return std::tie(id, qualifier) <=> std::tie(other.id, other.qualifier);
+    }
 };
 
 inline std::size_t hash_value(const Type& t)
@@ -0,0 +1,116 @@
+#include <utility>
+#include "NotificationDispatcher.h"
+#include "utils/log.h"
+
+namespace {
+/** How often are the notifications which were dropped or which failed reported */
+const auto reportInterval = std::chrono::minutes{1};
+}
+
+namespace alarms {
+
+NotificationDispatcher::NotificationDispatcher(Sender sender, const size_t capacity)
+    : m_log(spdlog::get("main"))
+    , m_sender(std::move(sender))
+    , m_capacity(capacity)
+    , m_counters{0, 0, 0, 0}
+    , m_reported{0, 0, 0, 0}
+    , m_overflowing(false)
+    , m_stop(false)
+    , m_thread([this]() { run(); })
+{
+}
+
+NotificationDispatcher::~NotificationDispatcher()
+{
+    {
+        std::unique_lock lck{m_mtx};
+        m_stop = true;
+    }
+    m_queued.notify_all();
+    m_thread.join();
+    m_log->info("Notifications: {} sent, {} dropped, {} failed", m_counters.sent, m_counters.dropped, m_counters.failed);
+}
+
+/** @brief Queue a notification for sending
+ *
+ * @return false if the queue is full and the notification was dropped
+ * */
+bool NotificationDispatcher::enqueue(StatusChangeNotification&& notification)
+{
+    {
+        std::unique_lock lck{m_mtx};
+        if (m_queue.size() >= m_capacity) {
+            ++m_counters.dropped;
+            if (!m_overflowing) {
+                m_overflowing = true;
+                m_log->warn("Notification queue is full ({} entries), dropping notifications", m_capacity);
+            }
+            return false;
+        }
+        if (m_overflowing) {
+            m_overflowing = false;
+            m_log->warn("Notification queue has room again, {} notifications dropped so far", m_counters.dropped);
+        }
+        m_queue.emplace_back(std::move(notification));
+        m_counters.depth = m_queue.size();
+    }
+    m_queued.notify_one();
+    return true;
+}
+
+NotificationDispatcher::Counters NotificationDispatcher::counters() const
+{
+    std::unique_lock lck{m_mtx};
+    return m_counters;
+}
+
+/** @brief Body of the dispatcher thread; it sends the notifications one by one, without holding the lock */
+void NotificationDispatcher::run()
+{
+    std::unique_lock lck{m_mtx};
+    auto nextReport = std::chrono::steady_clock::now() + reportInterval;
+    while (true) {
+        // also while the queue never gets empty, which is when the notifications get dropped
+        if (!m_queued.wait_until(lck, nextReport, [this]() { return m_stop || !m_queue.empty(); }) || std::chrono::steady_clock::now() >= nextReport) {
+            nextReport = std::chrono::steady_clock::now() + reportInterval;
+            reportProblems(lck);
+            continue;
+        }
+        if (m_queue.empty()) {
+            // only stopping once everything has been sent
+            return;
+        }
+
+        auto notification = std::move(m_queue.front());
+        m_queue.pop_front();
+        lck.unlock();
+
+        bool ok = true;
+        try {
+            m_sender(notification);
+        } catch (const std::exception& e) {
+            ok = false;
+            m_log->error("Cannot send a notification for {}: {}", notification.key.xpathIndex(), e.what());
+        }
+
+        lck.lock();
+        m_counters.depth = m_queue.size();
+        ++(ok ? m_counters.sent : m_counters.failed);
+    }
+}
+
+/** @brief Log the counters if some notifications were dropped or failed since the last time. Must be called with m_mtx locked. */
+void NotificationDispatcher::reportProblems(std::unique_lock<std::mutex>& lck)
+{
+    const auto counters = m_counters;
+    const auto reported = std::exchange(m_reported, counters);
+    if (counters.dropped == reported.dropped && counters.failed == reported.failed) {
+        return;
+    }
+    lck.unlock();
+    m_log->warn("Notifications since the last report: {} sent, {} dropped, {} failed; {} waiting in the queue",
+                counters.sent - reported.sent, counters.dropped - reported.dropped, counters.failed - reported.failed, counters.depth);
+    lck.lock();
+}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "Key.h"
+#include "StatusChangeHistory.h"
+#include "utils/log-fwd.h"
+
+namespace alarms {
+
+/** @short Everything which goes into an alarm-notification, copied out of the alarm when it changed */
+struct StatusChangeNotification {
+    InstanceKey key;
+    TimePoint time;
+    int32_t perceivedSeverity;
+    std::string text;
+};
+
+/** @short Sends notifications from a dedicated thread, so that whoever queues them does not wait for the delivery
+ *
+ * The queue is a bounded FIFO served by a single thread, so notifications are sent in the same order as they were
+ * queued, and the notifications of one alarm never overtake each other. When the queue is full, new notifications
+ * are dropped and counted. The notifications which are still queued are sent before the destructor returns.
+ *
+ * The counters are logged once per minute if any notifications were dropped or failed, and when the dispatcher stops.
+ * */
+class NotificationDispatcher {
+public:
+    using Sender = std::function<void(const StatusChangeNotification&)>;
+
+    struct Counters {
+        size_t depth; /**< Notifications which are waiting in the queue */
+        uint64_t sent;
+        uint64_t dropped; /**< Notifications which did not fit into the queue */
+        uint64_t failed; /**< Notifications which the sender refused with an exception */
+    };
+
+    NotificationDispatcher(Sender sender, const size_t capacity);
+    ~NotificationDispatcher();
+
+    bool enqueue(StatusChangeNotification&& notification);
+    Counters counters() const;
+
+private:
+    alarms::Log m_log;
+    Sender m_sender;
+    const size_t m_capacity;
+
+    mutable std::mutex m_mtx;
+    std::condition_variable m_queued;
+    std::deque<StatusChangeNotification> m_queue;
+    Counters m_counters;
+    Counters m_reported; /**< As of the last report */
+    bool m_overflowing; /**< Whether some notifications were dropped since the queue had room for the last time */
+    bool m_stop;
+    std::thread m_thread;
+
+    void run();
+    void reportProblems(std::unique_lock<std::mutex>& lck);
+};
+}
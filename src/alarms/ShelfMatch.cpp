@@ -8,65 +8,79 @@
 #include <libyang-cpp/Set.hpp>
 #include <libyang-cpp/Type.hpp>
 #include <libyang-cpp/Utils.hpp>
-#include "Key.h"
 #include "ShelfMatch.h"
 #include "utils/libyang.h"
 
-namespace {
-
-/** @brief Checks whether alarm's alarm-type-id is derived from identity */
-bool matchesIdentity(const libyang::Identity& identity, const alarms::Type& type)
-{
-    auto derivedIdentities = identity.derivedRecursive();
-    return std::any_of(derivedIdentities.begin(), derivedIdentities.end(), [&type](const auto& d) {
-        return libyang::qualifiedName(d) == type.id;
-    });
-}
-
-/** @brief Checks whether alarm matches a single shelf's type setting. Both alarm alarm-type-id and alarm-type-qualifier must match.
- *
- * @param node A set of /ietf-alarms:control/alarm-shelving/shelf/alarm-type nodes
- * */
-bool matchesType(const libyang::Set<libyang::DataNode>& alarmTypeNodes, const alarms::Type& type)
-{
-    return std::any_of(alarmTypeNodes.begin(), alarmTypeNodes.end(), [&type](const auto& node) {
-        return type.qualifier == alarms::utils::childValue(node, "alarm-type-qualifier-match") && // FIXME regexp matcher for qualifier
-            matchesIdentity(std::get<libyang::IdentityRef>(node.findPath("alarm-type-id")->asTerm().value()).schema, type);
-    });
-}
+namespace alarms {
 
-/** @brief Checks whether alarm matches a single shelf
+/** @brief Compile the shelving rules
  *
- * @param node A single /ietf-alarms:control/alarm-shelving/shelf node
+ * @param shelves Set of /ietf-alarms:control/alarm-shelving/shelf nodes
  * */
-bool matchesShelf(const libyang::DataNode& node, const alarms::InstanceKey& alarmKey)
+ShelvingRules::ShelvingRules(const libyang::Set<libyang::DataNode>& shelves, const IdentityTable& identities)
 {
     /* Each entry defines the criteria for shelving alarms.
      * Criteria are ANDed. If no criteria are specified, all alarms will be shelved.
      */
+    for (const auto& node : shelves) {
+        const auto index = m_shelves.size();
+        Shelf shelf{.name = utils::childValue(node, "name"), .anyType = true, .types = {}};
 
-    if (auto resources = node.findXPath("resource"); !resources.empty() && std::none_of(resources.begin(), resources.end(), [&alarmKey](const auto& resourceNode) { return resourceNode.asTerm().valueStr() == alarmKey.resource; })) {
-        return false;
-    }
+        auto resources = node.findXPath("resource");
+        for (const auto& resourceNode : resources) {
+            auto& byResource = m_shelvesByResource[resourceNode.asTerm().valueStr()];
+            if (byResource.empty() || byResource.back() != index) {
+                byResource.push_back(index);
+            }
+        }
+        if (resources.empty()) {
+            m_shelvesForAnyResource.push_back(index);
+        }
 
-    if (auto alarmTypes = node.findXPath("alarm-type"); !alarmTypes.empty() && !matchesType(alarmTypes, alarmKey.type)) {
-        return false;
-    }
+        // An alarm type matches when its alarm-type-id is derived from the configured identity (or is that identity),
+        // and when the alarm-type-qualifier is the same.
+        for (const auto& alarmTypeNode : node.findXPath("alarm-type")) {
+            shelf.anyType = false;
+            const auto qualifier = utils::childValue(alarmTypeNode, "alarm-type-qualifier-match"); // FIXME regexp matcher for qualifier
+            const auto identity = libyang::qualifiedName(std::get<libyang::IdentityRef>(alarmTypeNode.findPath("alarm-type-id")->asTerm().value()).schema);
+            if (auto base = identities.find(identity)) {
+                shelf.types.push_back({.base = *base, .qualifier = qualifier});
+            } else {
+                throw std::logic_error{"Identity " + identity + " is not known in the identity table"};
+            }
+        }
 
-    return true;
-}
+        m_shelves.emplace_back(std::move(shelf));
+    }
 }
 
-namespace alarms {
-
-/** @brief Returns name of the matching shelf for an alarm
- *
- * @param shelves Set of /ietf-alarms:control/alarm-shelving/shelf nodes
- * */
-std::optional<std::string> findMatchingShelf(const InstanceKey& alarmKey, const libyang::Set<libyang::DataNode>& shelves)
+/** @brief Returns name of the first shelf which matches an alarm */
+std::optional<std::string> ShelvingRules::findMatchingShelf(const InstanceKey& alarmKey, const IdentityTable& identities) const
 {
-    if (auto it = std::find_if(shelves.begin(), shelves.end(), [&alarmKey](const auto& node) { return matchesShelf(node, alarmKey); }); it != shelves.end()) {
-        return utils::childValue(*it, "name");
+    const auto identity = alarmKey.type.identity ? alarmKey.type.identity : identities.find(alarmKey.type.id);
+    auto matchesType = [&](const TypeMatch& type) {
+        return identity && type.qualifier == alarmKey.type.qualifier && identities.isDerivedFrom(*identity, type.base);
+    };
+
+    static const std::vector<size_t> none;
+    const auto it = m_shelvesByResource.find(alarmKey.resource);
+    const auto& byResource = it == m_shelvesByResource.end() ? none : it->second;
+
+    // both lists are sorted, so walk them in parallel in order to preserve the configured order of shelves
+    auto resourceIt = byResource.begin();
+    auto anyIt = m_shelvesForAnyResource.begin();
+    while (resourceIt != byResource.end() || anyIt != m_shelvesForAnyResource.end()) {
+        size_t index;
+        if (anyIt == m_shelvesForAnyResource.end() || (resourceIt != byResource.end() && *resourceIt < *anyIt)) {
+            index = *resourceIt++;
+        } else {
+            index = *anyIt++;
+        }
+
+        const auto& shelf = m_shelves[index];
+        if (shelf.anyType || std::any_of(shelf.types.begin(), shelf.types.end(), matchesType)) {
+            return shelf.name;
+        }
     }
     return std::nullopt;
 }
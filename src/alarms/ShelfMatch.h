@@ -7,11 +7,38 @@
 #pragma once
 #include <libyang-cpp/DataNode.hpp>
 #include <optional>
+#include <unordered_map>
+#include <vector>
+#include "Identities.h"
+#include "Key.h"
 
 namespace alarms {
 
-struct InstanceKey;
+/** @short The alarm-shelving configuration, compiled into a form which is cheap to evaluate
+ *
+ * Shelves are tried in the order in which they appear in the configuration, and the first one which matches wins.
+ * Only those shelves which either list the alarm's resource, or which do not restrict resources at all, are considered.
+ * */
+class ShelvingRules {
+public:
+    ShelvingRules() = default;
+    ShelvingRules(const libyang::Set<libyang::DataNode>& shelves, const IdentityTable& identities);
+
+    std::optional<std::string> findMatchingShelf(const InstanceKey& key, const IdentityTable& identities) const;
 
-std::optional<std::string> findMatchingShelf(const InstanceKey& key, const libyang::Set<libyang::DataNode>& shelves);
+private:
+    struct TypeMatch {
+        IdentityTable::Index base; /**< Alarms with this alarm-type-id or with any identity derived from it match */
+        std::string qualifier;
+    };
+    struct Shelf {
+        std::string name;
+        bool anyType;
+        std::vector<TypeMatch> types;
+    };
+    std::vector<Shelf> m_shelves;
+    std::unordered_map<std::string, std::vector<size_t>, boost::hash<std::string>> m_shelvesByResource; /**< Resource -> indexes of shelves which list it */
+    std::vector<size_t> m_shelvesForAnyResource; /**< Indexes of shelves without any resource criteria */
+};
 
 }
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include "StatusChangeHistory.h"
+
+namespace alarms {
+
+size_t StatusChangeHistory::size() const
+{
+    return m_size;
+}
+
+bool StatusChangeHistory::empty() const
+{
+    return !m_size;
+}
+
+const StatusChange& StatusChangeHistory::operator[](const size_t index) const
+{
+    return m_slots[(m_oldest + index) % m_slots.size()];
+}
+
+std::optional<uint16_t> StatusChangeHistory::limit() const
+{
+    return m_limit;
+}
+
+/** @brief Append the newest entry
+ *
+ * @return timestamp of the oldest entry if it had to be dropped to make room for the new one
+ * */
+std::optional<TimePoint> StatusChangeHistory::push(StatusChange&& change)
+{
+    if (m_limit && !*m_limit) {
+        return change.time;
+    }
+
+    if (m_limit && m_size == *m_limit) {
+        // the storage is exactly as big as the limit, so the oldest entry is followed by the newest one
+        auto evicted = m_slots[m_oldest].time;
+        m_slots[m_oldest] = std::move(change);
+        m_oldest = (m_oldest + 1) % m_slots.size();
+        return evicted;
+    }
+
+    if (m_size == m_slots.size()) {
+        auto capacity = std::max<size_t>(4, 2 * m_slots.size());
+        if (m_limit) {
+            capacity = std::min<size_t>(capacity, *m_limit);
+        }
+        reallocate(capacity);
+    }
+    m_slots[(m_oldest + m_size) % m_slots.size()] = std::move(change);
+    ++m_size;
+    return std::nullopt;
+}
+
+/** @brief Move all entries into a new storage of the given capacity, the oldest one first */
+void StatusChangeHistory::reallocate(const size_t capacity)
+{
+    std::vector<StatusChange> slots(capacity);
+    for (size_t i = 0; i < m_size; ++i) {
+        slots[i] = std::move(m_slots[(m_oldest + i) % m_slots.size()]);
+    }
+    m_slots = std::move(slots);
+    m_oldest = 0;
+}
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace alarms {
+using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
+
+struct StatusChange {
+    TimePoint time;
+    int32_t perceivedSeverity;
+    std::string text;
+};
+
+/** @short Status changes of a single alarm, kept in a circular list as per RFC 8632
+ *
+ * The storage grows up to the configured limit. Once the limit is reached, each new entry overwrites the oldest one
+ * in place. The storage is reallocated only when the limit changes. Evicted entries are reported by their timestamp.
+ * */
+class StatusChangeHistory {
+public:
+    size_t size() const;
+    bool empty() const;
+    /** @brief Access an entry by its age; 0 is the oldest one */
+    const StatusChange& operator[](const size_t index) const;
+    std::optional<uint16_t> limit() const;
+
+    std::optional<TimePoint> push(StatusChange&& change);
+
+    /** @brief Change the maximal number of entries, calling onEvicted(time) for each entry that had to be dropped */
+    template <typename Fn>
+    void setLimit(const std::optional<uint16_t> limit, Fn&& onEvicted)
+    {
+        m_limit = limit;
+        if (!limit) {
+            return;
+        }
+        if (m_size > *limit) {
+            dropOldest(m_size - *limit, onEvicted);
+        }
+        if (m_slots.size() > *limit) {
+            reallocate(*limit);
+        }
+    }
+
+    /** @brief Drop all but the newest count entries, calling onEvicted(time) for each of them */
+    template <typename Fn>
+    void keepNewest(const size_t count, Fn&& onEvicted)
+    {
+        if (m_size > count) {
+            dropOldest(m_size - count, onEvicted);
+        }
+    }
+
+private:
+    std::vector<StatusChange> m_slots;
+    size_t m_oldest = 0;
+    size_t m_size = 0;
+    std::optional<uint16_t> m_limit;
+
+    template <typename Fn>
+    void dropOldest(size_t count, Fn& onEvicted)
+    {
+        for (; count; --count) {
+            onEvicted(m_slots[m_oldest].time);
+            m_slots[m_oldest] = {};
+            m_oldest = (m_oldest + 1) % m_slots.size();
+            --m_size;
+        }
+    }
+
+    void reallocate(const size_t capacity);
+};
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <docopt.h>
 #include <memory>
 #include <spdlog/sinks/ansicolor_sink.h>
@@ -26,6 +27,27 @@ spdlog::level::level_enum parseLogLevel(const std::string& name, const docopt::v
     return static_cast<spdlog::level::level_enum>(5 - x);
 }
 
+long parseNonNegative(const std::string& name, const docopt::value& option)
+{
+    long x;
+    try {
+        x = option.asLong();
+    } catch (std::invalid_argument&) {
+        throw std::runtime_error(name + ": expecting integer");
+    }
+    if (x < 0)
+        throw std::runtime_error(name + ": expecting a non-negative number");
+    return x;
+}
+
+long parsePositive(const std::string& name, const docopt::value& option)
+{
+    auto x = parseNonNegative(name, option);
+    if (x == 0)
+        throw std::runtime_error(name + ": expecting a positive number");
+    return x;
+}
+
 static const char usage[] =
     R"(Monitor system health status.
 
@@ -33,6 +55,13 @@ Usage:
   sysrepo-ietf-alarmsd
     [--log-level=<Level>]
     [--sysrepo-log-level=<Level>]
+    [--write-behind=<ms>]
+    [--write-behind-max-pending=<N>]
+    [--publish-on-demand]
+    [--utc]
+    [--flap-damping=<ms>]
+    [--flap-summary-interval=<ms>]
+    [--state-dir=<path>]
   sysrepo-ietf-alarmsd (-h | --help)
   sysrepo-ietf-alarmsd --version
 
@@ -43,6 +72,24 @@ Options:
   --sysrepo-log-level=<N>    Log level for the sysrepo library [default: 2]
                              (0 -> critical, 1 -> error, 2 -> warning, 3 -> info,
                              4 -> debug, 5 -> trace)
+  --write-behind=<ms>        Publish alarm updates to the operational datastore
+                             at most once per this many milliseconds [default: 0]
+                             (0 -> publish each update right away)
+  --write-behind-max-pending=<N>
+                             In the write-behind mode, publish right away once
+                             this many alarm updates are pending [default: 1000]
+  --publish-on-demand        Do not push the alarm lists and the summary into the
+                             operational datastore; render them only when asked
+  --utc                      Report timestamps in UTC instead of the local time zone
+  --flap-damping=<ms>        Half-life of the penalty which alarms get for flapping
+                             between raised and cleared [default: 0]
+                             (0 -> no flap damping)
+  --flap-summary-interval=<ms>
+                             Record the status changes of a flapping alarm and notify
+                             about them at most once per this many milliseconds
+                             [default: 10000]
+  --state-dir=<path>         Keep a persistent copy of all alarms in this directory,
+                             so that they survive a restart of the daemon
 )";
 
 int main(int argc, char* argv[])
@@ -65,7 +112,27 @@ int main(int argc, char* argv[])
         spdlog::get("main")->set_level(parseLogLevel("Main logger", args["--log-level"]));
         spdlog::get("sysrepo")->set_level(parseLogLevel("Sysrepo logger", args["--sysrepo-log-level"]));
 
-        auto daemon = std::make_unique<alarms::Daemon>();
+        std::optional<alarms::WriteBehind> writeBehind;
+        if (auto window = parseNonNegative("Write-behind window", args["--write-behind"])) {
+            writeBehind = alarms::WriteBehind{
+                .window = std::chrono::milliseconds{window},
+                .maxPendingUpdates = static_cast<unsigned>(parsePositive("Write-behind pending updates", args["--write-behind-max-pending"])),
+            };
+        }
+
+        std::optional<alarms::FlapDamping> flapDamping;
+        if (auto halfLife = parseNonNegative("Flap damping half-life", args["--flap-damping"])) {
+            flapDamping = alarms::FlapDamping{};
+            flapDamping->halfLife = std::chrono::milliseconds{halfLife};
+            flapDamping->summaryInterval = std::chrono::milliseconds{parsePositive("Flap summary interval", args["--flap-summary-interval"])};
+        }
+
+        auto daemon = std::make_unique<alarms::Daemon>(
+            writeBehind,
+            args["--publish-on-demand"].asBool() ? alarms::Publishing::OnDemand : alarms::Publishing::Push,
+            args["--utc"].asBool() ? alarms::utils::TimeZone::UTC : alarms::utils::TimeZone::Local,
+            flapDamping,
+            args["--state-dir"] ? std::optional<std::filesystem::path>{args["--state-dir"].asString()} : std::nullopt);
         spdlog::get("main")->info("Alarms daemon initialized");
 
         alarms::utils::waitUntilSignaled();
@@ -6,8 +6,14 @@
  */
 
 #include <libyang-cpp/DataNode.hpp>
+#include <libyang-cpp/Utils.hpp>
+#include <vector>
 #include "utils/libyang.h"
 
+extern "C" {
+#include <libyang/libyang.h>
+}
+
 namespace alarms::utils {
 /** @brief Extract text value of a leaf which is a child of the given parent */
 std::string childValue(const libyang::DataNode& node, const std::string& leafName)
@@ -23,4 +29,38 @@ std::string childValue(const libyang::DataNode& node, const std::string& leafNam
 
     return leaf->asTerm().valueStr();
 }
+
+/** @short Create a list instance as a child of the parent node from the values of its keys
+ *
+ * Unlike creating the instance from its path, this works with any key values, even those which contain both single
+ * and double quotes, as there is no XPath involved. The keys must be listed in the order of their definition in the
+ * schema. Values of identityrefs are expected in the JSON format, i.e., prefixed by a module name.
+ * */
+libyang::DataNode newListInstance(libyang::DataNode& parent, const std::string& listName, std::initializer_list<std::string_view> keys, const bool output)
+{
+    std::vector<const char*> values;
+    std::vector<uint32_t> lengths;
+    for (const auto& key : keys) {
+        values.push_back(key.data());
+        lengths.push_back(key.size());
+    }
+
+    // libyang-cpp can only hand out nodes which it has created, so the new node is created within a temporary copy
+    // of the parent, and moved to its place afterwards
+    auto scratch = *parent.duplicate();
+    auto rawScratch = libyang::getRawNode(scratch);
+    if (lyd_new_list3(rawScratch, nullptr, listName.c_str(), values.data(), lengths.data(), output ? LYD_NEW_VAL_OUTPUT : 0, nullptr) != LY_SUCCESS) {
+        throw std::runtime_error("Cannot create list instance '" + listName + "': " + ly_errmsg(LYD_CTX(rawScratch)));
+    }
+
+    // a copy of a list instance also contains its keys, so look for the new node by its name
+    for (auto child : scratch.immediateChildren()) {
+        if (child.schema().name() == listName) {
+            child.unlink();
+            parent.insertChild(child);
+            return child;
+        }
+    }
+    throw std::logic_error("Created list instance '" + listName + "' not found");
+}
 }
@@ -6,7 +6,9 @@
  */
 
 #pragma once
+#include <initializer_list>
 #include <string>
+#include <string_view>
 
 namespace libyang {
 class DataNode;
@@ -15,4 +17,5 @@ class DataNode;
 namespace alarms::utils {
 
 std::string childValue(const libyang::DataNode& node, const std::string& name);
+libyang::DataNode newListInstance(libyang::DataNode& parent, const std::string& listName, std::initializer_list<std::string_view> keys, const bool output = false);
 }
@@ -0,0 +1,110 @@
+#include <date/tz.h>
+#include <optional>
+#include "utils/time.h"
+
+namespace {
+
+/** @short Offset of the local time zone, and the period in which it applies */
+struct LocalOffset {
+    date::sys_seconds begin;
+    date::sys_seconds end;
+    std::chrono::seconds offset;
+};
+
+std::chrono::seconds localOffset(const date::sys_seconds& time)
+{
+    // one copy per thread, so there is no locking
+    thread_local std::optional<LocalOffset> cache;
+    if (!cache || time < cache->begin || time >= cache->end) {
+        auto info = date::current_zone()->get_info(time);
+        cache = LocalOffset{info.begin, info.end, info.offset};
+    }
+    return cache->offset;
+}
+
+/** @brief Number of decimal digits of the fractional seconds, in the same way as date::format() prints them */
+constexpr int fractionalDigits()
+{
+    int digits = 0;
+    for (auto den = std::chrono::system_clock::period::den; den > 1; den /= 10) {
+        ++digits;
+    }
+    return digits;
+}
+
+char* writeDigits(char* out, long long value, const int width)
+{
+    for (auto i = width; i-- > 0;) {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+char* writeYear(char* out, const int year)
+{
+    long long value = year;
+    if (value < 0) {
+        *out++ = '-';
+        value = -value;
+    }
+    int width = 4;
+    for (auto limit = 10'000LL; value >= limit; limit *= 10) {
+        ++width;
+    }
+    return writeDigits(out, value, width);
+}
+}
+
+namespace alarms::utils {
+
+YangTimeFormatter::YangTimeFormatter(const TimeZone zone)
+    : m_zone(zone)
+{
+}
+
+/** @brief Format the time point into the buffer, returning the part of the buffer which was used */
+std::string_view YangTimeFormatter::format(const std::chrono::system_clock::time_point& timePoint, Buffer& buffer) const
+{
+    using namespace std::chrono;
+
+    const auto wholeSeconds = floor<seconds>(timePoint);
+    const auto fraction = timePoint - wholeSeconds;
+    const auto offset = m_zone == TimeZone::Local ? localOffset(wholeSeconds) : seconds{0};
+    const auto localTime = wholeSeconds + offset;
+    const auto day = floor<days>(localTime);
+    const year_month_day ymd{day};
+    const hh_mm_ss hms{localTime - day};
+
+    auto out = buffer.data();
+    out = writeYear(out, static_cast<int>(ymd.year()));
+    *out++ = '-';
+    out = writeDigits(out, static_cast<unsigned>(ymd.month()), 2);
+    *out++ = '-';
+    out = writeDigits(out, static_cast<unsigned>(ymd.day()), 2);
+    *out++ = 'T';
+    out = writeDigits(out, hms.hours().count(), 2);
+    *out++ = ':';
+    out = writeDigits(out, hms.minutes().count(), 2);
+    *out++ = ':';
+    out = writeDigits(out, hms.seconds().count(), 2);
+    if constexpr (fractionalDigits() > 0) {
+        *out++ = '.';
+        out = writeDigits(out, fraction.count(), fractionalDigits());
+    }
+
+    const auto offsetMinutes = duration_cast<minutes>(abs(offset)).count();
+    *out++ = offset < seconds{0} ? '-' : '+';
+    out = writeDigits(out, offsetMinutes / 60, 2);
+    *out++ = ':';
+    out = writeDigits(out, offsetMinutes % 60, 2);
+
+    return {buffer.data(), static_cast<size_t>(out - buffer.data())};
+}
+
+std::string YangTimeFormatter::operator()(const std::chrono::system_clock::time_point& timePoint) const
+{
+    Buffer buffer;
+    return std::string{format(timePoint, buffer)};
+}
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace alarms::utils {
+
+/** @short Which time zone offset is used in the formatted timestamps */
+enum class TimeZone {
+    Local, /**< The local time zone of the system, including its DST rules */
+    UTC,
+};
+
+/** @short Format time points as YANG's date-and-time
+ *
+ * With TimeZone::Local, the result is the same as what libyang::yangTimeFormat() with TimezoneInterpretation::Local
+ * produces. The offset of the local time zone is only looked up again when a time point falls out of the period in
+ * which the previously found offset applies, e.g., on a DST change.
+ * */
+class YangTimeFormatter {
+public:
+    /** @short Long enough for "-32767-12-31T23:59:59.999999999+14:00" */
+    using Buffer = std::array<char, 48>;
+
+    explicit YangTimeFormatter(const TimeZone zone);
+    std::string_view format(const std::chrono::system_clock::time_point& timePoint, Buffer& buffer) const;
+    std::string operator()(const std::chrono::system_clock::time_point& timePoint) const;
+
+private:
+    TimeZone m_zone;
+};
+}
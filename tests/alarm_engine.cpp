@@ -0,0 +1,256 @@
+#include "trompeloeil_doctest.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "alarms/AlarmEngine.h"
+#include "test_alarm_helpers.h"
+#include "test_log_setup.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+alarms::AlarmInput input(const int i, const int32_t severity, const std::string& text = "text")
+{
+    return {.key = testKey(i), .severity = severity, .text = text};
+}
+
+/** @short Counts the events which the engine emits */
+struct CountingEvents : alarms::AlarmEngine::Events {
+    std::atomic<unsigned> updates{0};
+    std::atomic<unsigned> newStatusChanges{0};
+    std::atomic<unsigned> notifications{0};
+    std::atomic<unsigned> dampingStarted{0};
+    std::atomic<unsigned> removedAlarms{0};
+    std::atomic<unsigned> removedStatusChanges{0};
+    std::atomic<unsigned> reshelved{0};
+
+    void alarmUpdated(const alarms::InstanceKey&, const alarms::AlarmEntry&, const alarms::AlarmEngine::AlarmChange& change) override
+    {
+        ++updates;
+        newStatusChanges += change.newStatusChange;
+        notifications += change.notify;
+        dampingStarted += change.dampingStarted;
+        removedStatusChanges += !!change.removedStatusChange;
+    }
+
+    void alarmRemoved(const alarms::InstanceKey&, const alarms::AlarmEntry&) override
+    {
+        ++removedAlarms;
+    }
+
+    void statusChangeRemoved(const alarms::InstanceKey&, const alarms::AlarmEntry&, const alarms::TimePoint&) override
+    {
+        ++removedStatusChanges;
+    }
+
+    void alarmReshelved(const alarms::InstanceKey&, const alarms::AlarmEntry&, const std::optional<std::string>&) override
+    {
+        ++reshelved;
+    }
+};
+
+size_t statusChanges(alarms::AlarmEngine& engine, const int i)
+{
+    size_t res = 0;
+    REQUIRE(engine.visit(testKey(i), [&](const alarms::AlarmEntry& alarm) { res = alarm.statusChanges.size(); }));
+    return res;
+}
+}
+
+TEST_CASE("Alarm engine")
+{
+    TEST_INIT_LOGS;
+    CountingEvents events;
+    alarms::AlarmEngine engine{events};
+    const auto now = alarms::TimePoint{} + 1000h;
+
+    REQUIRE(engine.update(now, input(1, 5)));
+    REQUIRE(events.updates == 1);
+    REQUIRE(events.notifications == 1);
+    REQUIRE(engine.statistics().alarms == 1);
+    REQUIRE(engine.statistics().perSeverity[5].total == 1);
+    REQUIRE(engine.alarmListLastChanged() >= now);
+
+    // nothing has changed
+    REQUIRE(!engine.update(now + 1s, input(1, 5)));
+    REQUIRE(events.updates == 1);
+
+    // an alarm which does not exist cannot be cleared
+    REQUIRE(!engine.update(now + 1s, input(2, alarms::ClearedSeverity)));
+    REQUIRE(!engine.visit(testKey(2), [](const alarms::AlarmEntry&) {}));
+
+    REQUIRE(engine.update(now + 2s, input(1, alarms::ClearedSeverity, "cleared")));
+    REQUIRE(engine.update(now + 3s, input(1, 4, "raised again")));
+    REQUIRE(events.updates == 3);
+    REQUIRE(events.newStatusChanges == 3);
+    REQUIRE(statusChanges(engine, 1) == 3);
+    REQUIRE(engine.statistics().perSeverity[4].total == 1);
+    REQUIRE(engine.statistics().perSeverity[5].total == 0);
+
+    SECTION("Purge")
+    {
+        alarms::AlarmFilter everything;
+        REQUIRE(engine.purge(everything, true, now + 4s) == 0);
+        REQUIRE(engine.purge(everything, false, now + 4s) == 1);
+        REQUIRE(events.removedAlarms == 1);
+        REQUIRE(engine.statistics().alarms == 0);
+        REQUIRE(!engine.visit(testKey(1), [](const alarms::AlarmEntry&) {}));
+    }
+
+    SECTION("Compress")
+    {
+        REQUIRE(engine.compress(alarms::AlarmFilter{}, false) == 1);
+        REQUIRE(events.removedStatusChanges == 2);
+        REQUIRE(statusChanges(engine, 1) == 1);
+    }
+
+    SECTION("Limited status-change history")
+    {
+        auto settings = engine.settings();
+        settings.maxAlarmStatusChanges = 2;
+        REQUIRE(engine.reconfigure(settings, std::nullopt));
+        REQUIRE(events.removedStatusChanges == 1);
+        REQUIRE(statusChanges(engine, 1) == 2);
+
+        // the oldest one is dropped right away
+        REQUIRE(engine.update(now + 4s, input(1, 6)));
+        REQUIRE(events.removedStatusChanges == 2);
+        REQUIRE(statusChanges(engine, 1) == 2);
+
+        // no change of the limit, nothing to do
+        REQUIRE(!engine.reconfigure(settings, std::nullopt));
+    }
+
+    SECTION("Updates which were timestamped out of order")
+    {
+        // e.g., a batch which took its timestamp before a single update, but which got to this alarm only afterwards
+        REQUIRE(engine.update(now + 1s, input(1, 6)));
+        REQUIRE(engine.update(now + 3s, input(1, alarms::ClearedSeverity)));
+        engine.visit(testKey(1), [&](const alarms::AlarmEntry& alarm) {
+            REQUIRE(alarm.lastChanged == now + 3s + 2ns);
+            REQUIRE(alarm.statusChanges.size() == 5);
+            for (size_t i = 1; i < alarm.statusChanges.size(); ++i) {
+                REQUIRE(alarm.statusChanges[i - 1].time < alarm.statusChanges[i].time);
+            }
+        });
+    }
+
+        SECTION("Notify about raised and cleared alarms only")
+    {
+        auto settings = engine.settings();
+        settings.notifyStatusChanges = alarms::NotifyStatusChanges::RaiseAndClear;
+        REQUIRE(!engine.reconfigure(settings, std::nullopt));
+
+        REQUIRE(engine.update(now + 4s, input(1, 6, "worse")));
+        REQUIRE(events.updates == 4);
+        REQUIRE(events.notifications == 3);
+
+        REQUIRE(engine.update(now + 5s, input(1, alarms::ClearedSeverity)));
+        REQUIRE(events.notifications == 4);
+    }
+}
+
+TEST_CASE("Flap damping in the alarm engine")
+{
+    TEST_INIT_LOGS;
+    CountingEvents events;
+    alarms::FlapDamping damping;
+    damping.halfLife = 10s;
+    damping.summaryInterval = 1s;
+    alarms::AlarmEngine engine{events, damping};
+    const auto now = alarms::TimePoint{} + 1000h;
+
+    // the fourth flap starts the damping, and that update still goes through
+    REQUIRE(engine.update(now, input(1, 5)));
+    REQUIRE(engine.update(now, input(1, alarms::ClearedSeverity)));
+    REQUIRE(engine.update(now, input(1, 5)));
+    REQUIRE(engine.update(now, input(1, alarms::ClearedSeverity)));
+    REQUIRE(!engine.hasDampedAlarms());
+    REQUIRE(engine.update(now, input(1, 5)));
+    REQUIRE(events.dampingStarted == 1);
+    REQUIRE(engine.hasDampedAlarms());
+    REQUIRE(events.updates == 5);
+
+    // the alarm changes right away, its status change and its notification are held until the next summary
+    REQUIRE(engine.update(now + 100ms, input(1, alarms::ClearedSeverity)));
+    REQUIRE(engine.update(now + 200ms, input(1, 3, "flapping")));
+    REQUIRE(events.updates == 7);
+    REQUIRE(events.newStatusChanges == 5);
+    REQUIRE(events.notifications == 5);
+    REQUIRE(statusChanges(engine, 1) == 5);
+
+    REQUIRE(engine.summarizeDampedAlarms(now + 1s) == 1);
+    REQUIRE(events.updates == 8);
+    REQUIRE(events.notifications == 6);
+    REQUIRE(statusChanges(engine, 1) == 6);
+    engine.visit(testKey(1), [](const alarms::AlarmEntry& alarm) {
+        REQUIRE(alarm.text == "flapping");
+        REQUIRE(alarm.flapping.damped);
+    });
+
+    // nothing was held since
+    REQUIRE(engine.summarizeDampedAlarms(now + 2s) == 0);
+
+    // released once it calms down; that is an update as well, but without any new status change
+    REQUIRE(engine.summarizeDampedAlarms(now + 60s) == 1);
+    REQUIRE(events.updates == 9);
+    REQUIRE(events.newStatusChanges == 6);
+    REQUIRE(!engine.hasDampedAlarms());
+}
+
+TEST_CASE("Concurrent updates in the alarm engine")
+{
+    TEST_INIT_LOGS;
+
+    constexpr int NUM_ALARMS = 1'000;
+    constexpr int UPDATES_PER_ALARM = 10;
+    constexpr unsigned THREADS = 4;
+    CountingEvents events;
+    alarms::AlarmEngine engine{events};
+    const auto epoch = alarms::TimePoint{} + 1000h;
+
+    for (int i = 0; i < NUM_ALARMS; ++i) {
+        engine.update(epoch, input(i, 2 + i % 5));
+    }
+    REQUIRE(engine.statistics().alarms == NUM_ALARMS);
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < THREADS; ++t) {
+        workers.emplace_back([&, t]() {
+            for (int round = 0; round < UPDATES_PER_ALARM; ++round) {
+                for (int i = t; i < NUM_ALARMS; i += THREADS) {
+                    engine.update(epoch + std::chrono::seconds{1 + round}, input(i, round % 2 ? 3 : alarms::ClearedSeverity));
+                }
+            }
+        });
+    }
+
+    // each alarm is counted exactly once even while it is being updated
+    std::atomic<bool> done{false};
+    std::atomic<unsigned> inconsistent{0};
+    std::thread reader([&]() {
+        while (!done) {
+            const auto statistics = engine.statistics();
+            unsigned total = 0;
+            for (const auto& perSeverity : statistics.perSeverity) {
+                total += perSeverity.total;
+                inconsistent += perSeverity.cleared > perSeverity.total;
+            }
+            inconsistent += statistics.alarms != NUM_ALARMS || total != NUM_ALARMS;
+        }
+    });
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    done = true;
+    reader.join();
+
+    REQUIRE(inconsistent == 0);
+    REQUIRE(engine.statistics().alarms == NUM_ALARMS);
+    REQUIRE(events.updates == NUM_ALARMS * (1 + UPDATES_PER_ALARM));
+    REQUIRE(statusChanges(engine, 42) == 1 + UPDATES_PER_ALARM);
+    REQUIRE(engine.purge(alarms::AlarmFilter{}, false, epoch + 1h) == NUM_ALARMS);
+    REQUIRE(events.removedAlarms == NUM_ALARMS);
+}
@@ -0,0 +1,71 @@
+#include "trompeloeil_doctest.h"
+#include <chrono>
+#include <random>
+#include <sysrepo-cpp/Connection.hpp>
+#include "alarms/AlarmEntry.h"
+#include "alarms/Filters.h"
+#include "test_alarm_helpers.h"
+#include "test_log_setup.h"
+#include "test_sysrepo_helpers.h"
+
+using namespace std::string_literals;
+
+namespace {
+libyang::DataNode rpcInput(const libyang::Context& ctx, const std::string& rpcPath, const std::map<std::string, std::string>& input)
+{
+    auto node = ctx.newPath(rpcPath, std::nullopt);
+    for (const auto& [k, v] : input) {
+        node.newPath(rpcPath + "/"s + k, v);
+    }
+    return *node.findPath(rpcPath);
+}
+
+template <typename Filter>
+size_t countMatching(const Filter& filter, const std::vector<std::pair<alarms::InstanceKey, alarms::AlarmEntry>>& alarms)
+{
+    size_t matching = 0;
+    for (const auto& [key, alarm] : alarms) {
+        matching += filter.matches(key, alarm);
+    }
+    return matching;
+}
+}
+
+TEST_CASE("Alarm filters")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    TEST_SYSREPO_CLIENT_INIT(sess);
+    auto ctx = sess->getContext();
+
+    constexpr size_t NUM_ALARMS = 10'000;
+    const auto now = std::chrono::system_clock::now();
+    std::mt19937 rng{666};
+    std::vector<std::pair<alarms::InstanceKey, alarms::AlarmEntry>> alarms(NUM_ALARMS);
+    size_t expectedPurged = 0;
+    size_t expectedCompressed = 0;
+    for (size_t i = 0; i < NUM_ALARMS; ++i) {
+        auto& [key, alarm] = alarms[i];
+        key = {.type = {.id = "alarms-test:alarm-" + std::to_string(1 + i % 2), .qualifier = i % 3 ? "" : "q"}, .resource = "resource-" + std::to_string(i % 100)};
+        // stay clear of the older-than boundary, the filter takes its own "now"
+        const auto ageInDays = rng() % 30;
+        alarm.lastChanged = now - std::chrono::days{ageInDays} - std::chrono::hours{12};
+        alarm.lastSeverity = 2 + rng() % 5;
+        alarm.isCleared = rng() % 2;
+
+        if (alarm.isCleared && ageInDays >= 7 && alarm.lastSeverity < 5 /* major */) {
+            ++expectedPurged;
+        }
+        if (key.resource == "resource-42" && key.type.id == "alarms-test:alarm-1" && key.type.qualifier.empty()) {
+            ++expectedCompressed;
+        }
+    }
+
+    alarms::PurgeFilter purge{rpcInput(ctx, purgeRpcPrefix, {{"alarm-clearance-status", "cleared"}, {"older-than/days", "7"}, {"severity/below", "major"}})};
+    REQUIRE(countMatching(purge, alarms) == expectedPurged);
+
+    alarms::CompressFilter compress{rpcInput(ctx, compressAlarmsRpcPrefix, {{"resource", "resource-42"}, {"alarm-type-id", "alarms-test:alarm-1"}, {"alarm-type-qualifier", ""}})};
+    REQUIRE(countMatching(compress, alarms) == expectedCompressed);
+
+    alarms::PurgeFilter purgeAll{rpcInput(ctx, purgeRpcPrefix, {{"alarm-clearance-status", "any"}})};
+    REQUIRE(countMatching(purgeAll, alarms) == NUM_ALARMS);
+}
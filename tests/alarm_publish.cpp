@@ -1,5 +1,8 @@
 #include "trompeloeil_doctest.h"
 #include <algorithm>
+#include <atomic>
+#include <set>
+#include <thread>
 #include <sysrepo-cpp/Connection.hpp>
 #include "alarms/Daemon.h"
 #include "test_alarm_helpers.h"
@@ -739,12 +742,17 @@ TEST_CASE("Basic alarm publishing and updating")
         REQUIRE(checkAlarmListLastChanged(actualDataFromSysrepo, "/ietf-interfaces:interface[name=\"eth2\"]", "alarms-test:alarm-2-2", ""));
     }
 
-    SECTION("Not properly escaped resource string throws")
+    SECTION("Resource with both single and double quotes")
     {
+        const std::string resource = "/some:hardware/entry[n1='ahoj\"'][n2=\"cau']`";
         CLIENT_INTRODUCE_ALARM(cli1Sess, "alarms-test:alarm-2-2", "", {}, {}, "For escaping test");
-        REQUIRE_THROWS_WITH([&]() { CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "/some:hardware/entry[n1='ahoj\"'][n2=\"cau']`", "minor", "A text"); }(),
-                            "Couldn't send RPC: SR_ERR_OPERATION_FAILED\n"
-                            " Encountered mixed single and double quotes in XPath; can't properly escape. (SR_ERR_OPERATION_FAILED)");
+        CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", resource, "minor", "A text");
+        CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", resource, "major", "Another text");
+
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational);
+        REQUIRE(data.at("/number-of-alarms") == "2");
+        REQUIRE(std::count_if(data.begin(), data.end(), [&](const auto& leaf) { return leaf.second == resource; }) == 1);
+        REQUIRE(std::count_if(data.begin(), data.end(), [&](const auto& leaf) { return leaf.first.ends_with("/perceived-severity") && leaf.second == "major"; }) == 2);
     }
 
     SECTION("Validation against inventory")
@@ -775,6 +783,412 @@ TEST_CASE("Basic alarm publishing and updating")
                             " NETCONF: application: data-missing: Alarm inventory doesn't allow severity 'indeterminate' for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1).");
         CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "another-resource", "critical", "valid");
         CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "another-resource", "cleared", "valid");
+
+        SECTION("Removing stuff from the inventory")
+        {
+            {
+                alarms::utils::ScopedDatastoreSwitch s(*cli1Sess, sysrepo::Datastore::Operational);
+                cli1Sess->deleteItem(alarmInventoryPrefix + "/alarm-type[alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier='']/resource[.='another-resource']");
+                cli1Sess->deleteItem(alarmInventoryPrefix + "/alarm-type[alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier='']/severity-level[.='major']");
+                cli1Sess->applyChanges();
+            }
+            REQUIRE_THROWS_WITH([&]() { CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "another-resource", "critical", "Removed resource"); }(),
+                                "Couldn't send RPC: SR_ERR_OPERATION_FAILED\n"
+                                " Alarm inventory doesn't allow resource 'another-resource' for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1). (SR_ERR_OPERATION_FAILED)\n"
+                                " NETCONF: application: data-missing: Alarm inventory doesn't allow resource 'another-resource' for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1).");
+            REQUIRE_THROWS_WITH([&]() { CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "a-resource", "major", "Removed severity"); }(),
+                                "Couldn't send RPC: SR_ERR_OPERATION_FAILED\n"
+                                " Alarm inventory doesn't allow severity 'major' for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1). (SR_ERR_OPERATION_FAILED)\n"
+                                " NETCONF: application: data-missing: Alarm inventory doesn't allow severity 'major' for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1).");
+            CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "a-resource", "critical", "Still valid");
+
+            {
+                alarms::utils::ScopedDatastoreSwitch s(*cli1Sess, sysrepo::Datastore::Operational);
+                cli1Sess->deleteItem(alarmInventoryPrefix + "/alarm-type[alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier='']");
+                cli1Sess->applyChanges();
+            }
+            REQUIRE_THROWS_WITH([&]() { CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "a-resource", "critical", "Removed type"); }(),
+                                "Couldn't send RPC: SR_ERR_OPERATION_FAILED\n"
+                                " No alarm inventory entry for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1). (SR_ERR_OPERATION_FAILED)\n"
+                                " NETCONF: application: data-missing: No alarm inventory entry for [alarm-type-id='alarms-test:alarm-2-2'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1).");
+        }
+
+        SECTION("Rebuilding the whole inventory in background")
+        {
+            constexpr auto NUM_TYPES = 50;
+            for (int i = 0; i < NUM_TYPES; ++i) {
+                CLIENT_INTRODUCE_ALARM(cli1Sess, "alarms-test:alarm-1", "q-" + std::to_string(i), ({"r1", "r2"}), {}, "desc");
+            }
+            CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-1", "q-0", "r2", "critical", "valid");
+
+            {
+                // too many alarm types change at once, so this is not applied incrementally
+                alarms::utils::ScopedDatastoreSwitch s(*cli1Sess, sysrepo::Datastore::Operational);
+                for (int i = 0; i < NUM_TYPES; ++i) {
+                    cli1Sess->deleteItem(alarmInventoryPrefix + "/alarm-type[alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='q-" + std::to_string(i) + "']/resource[.='r2']");
+                }
+                cli1Sess->applyChanges();
+            }
+
+            // alarms are validated against the previous snapshot until the new one is ready
+            for (int attempt = 0; attempt < 100; ++attempt) {
+                try {
+                    CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-1", "q-0", "r2", "critical", "maybe valid");
+                } catch (std::exception&) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds{50});
+            }
+            REQUIRE_THROWS_WITH([&]() { CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-1", "q-" + std::to_string(NUM_TYPES - 1), "r2", "critical", "Removed resource"); }(),
+                                "Couldn't send RPC: SR_ERR_OPERATION_FAILED\n"
+                                " Alarm inventory doesn't allow resource 'r2' for [alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='q-49'] -- see RFC8632 (sec. 4.1). (SR_ERR_OPERATION_FAILED)\n"
+                                " NETCONF: application: data-missing: Alarm inventory doesn't allow resource 'r2' for [alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='q-49'] -- see RFC8632 (sec. 4.1).");
+            CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-1", "q-" + std::to_string(NUM_TYPES - 1), "r1", "critical", "Still valid");
+            CLIENT_ALARM_RPC(cli1Sess, "alarms-test:alarm-2-2", "", "a-resource", "critical", "Other types are still valid");
+        }
+    }
+}
+
+TEST_CASE("Batched alarm publishing")
+{
+    TEST_SYSREPO_INIT_LOGS;
+
+    copyStartupDatastore("ietf-alarms");
+
+    auto daemon = std::make_unique<alarms::Daemon>();
+
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+
+    CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "high", {}, {}, "High temperature on any resource with any severity");
+    CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-2-1", "", ({"psu-1"}), ({"minor", "major"}), "Alarm with specific severity and resource.");
+
+    auto batchTime = CLIENT_ALARM_BATCH_RPC(userSess,
+                                            ({
+                                                {"alarms-test:alarm-1", "high", "edfa", "warning", "Hey, I'm overheating."},
+                                                {"alarms-test:alarm-1", "high", "wss", "major", "Melting."},
+                                                {"alarms-test:alarm-2-1", "", "psu-1", "critical", "More juice pls."},
+                                                {"alarms-test:alarm-2-1", "", "psu-2", "major", "More juice pls."},
+                                            }),
+                                            ({
+                                                BATCH_OK(1, "edfa", "alarms-test:alarm-1", "high"),
+                                                BATCH_OK(2, "wss", "alarms-test:alarm-1", "high"),
+                                                BATCH_REJECTED(3, "psu-1", "alarms-test:alarm-2-1", "", "Alarm inventory doesn't allow severity 'critical' for [alarm-type-id='alarms-test:alarm-2-1'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1)."),
+                                                BATCH_REJECTED(4, "psu-2", "alarms-test:alarm-2-1", "", "Alarm inventory doesn't allow resource 'psu-2' for [alarm-type-id='alarms-test:alarm-2-1'][alarm-type-qualifier=''] -- see RFC8632 (sec. 4.1)."),
+                                            }));
+
+    REQUIRE(dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational) == PropsWithTimeTest{
+                {"/number-of-alarms", "2"},
+                {"/last-changed", batchTime},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", ""},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-id", "alarms-test:alarm-1"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-qualifier", "high"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/resource", "edfa"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/is-cleared", "false"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/perceived-severity", "warning"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-text", "Hey, I'm overheating."},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/time-created", batchTime},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-raised", batchTime},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-changed", batchTime},
+                ALARM_STATUS_CHANGE_IMPL("/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", 1, "edfa", "alarms-test:alarm-1", "high", batchTime, "warning", "Hey, I'm overheating."),
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", ""},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-id", "alarms-test:alarm-1"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-qualifier", "high"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/resource", "wss"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/is-cleared", "false"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/perceived-severity", "major"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-text", "Melting."},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/time-created", batchTime},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-raised", batchTime},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-changed", batchTime},
+                ALARM_STATUS_CHANGE_IMPL("/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", 2, "wss", "alarms-test:alarm-1", "high", batchTime, "major", "Melting."),
+            });
+
+    SECTION("Clearing in a batch")
+    {
+        CLIENT_ALARM_BATCH_RPC(userSess,
+                               ({
+                                   {"alarms-test:alarm-1", "high", "edfa", "cleared", "Cooled down."},
+                                   {"alarms-test:alarm-1", "high", "roadm", "cleared", "Never raised."},
+                               }),
+                               ({
+                                   BATCH_OK(1, "edfa", "alarms-test:alarm-1", "high"),
+                                   BATCH_OK(2, "roadm", "alarms-test:alarm-1", "high"),
+                               }));
+
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational);
+        REQUIRE(data["/number-of-alarms"] == "2");
+        REQUIRE(data["/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/is-cleared"] == "true");
+        REQUIRE(data["/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/is-cleared"] == "false");
+        REQUIRE(data.count("/alarm[resource='roadm'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']") == 0);
+    }
+
+    SECTION("Several updates of the same alarm in a batch")
+    {
+        const auto flapTime = CLIENT_ALARM_BATCH_RPC(userSess,
+                                                     ({
+                                                         {"alarms-test:alarm-1", "high", "edfa", "cleared", "Cooled down."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "major", "Overheating again."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "cleared", "Cooled down again."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "minor", "Not this again."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "critical", "On fire."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "cleared", "Extinguished."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "warning", "Smoldering."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "indeterminate", "Who knows."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "major", "Overheating for the last time."},
+                                                         {"alarms-test:alarm-1", "high", "edfa", "cleared", "Finally cool."},
+                                                     }),
+                                                     ({
+                                                         BATCH_OK(1, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(2, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(3, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(4, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(5, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(6, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(7, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(8, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(9, "edfa", "alarms-test:alarm-1", "high"),
+                                                         BATCH_OK(10, "edfa", "alarms-test:alarm-1", "high"),
+                                                     }));
+
+        // the entries are processed by their index, not by the order in which they were sent (10 sorts before 2)
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational);
+        const auto edfa = "/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']"s;
+        REQUIRE(data["/number-of-alarms"] == "2");
+        REQUIRE(data[edfa + "/is-cleared"] == "true");
+        REQUIRE(data[edfa + "/perceived-severity"] == "major");
+        REQUIRE(data[edfa + "/alarm-text"] == "Finally cool.");
+        REQUIRE(std::count_if(data.begin(), data.end(), [&](const auto& kv) { return kv.first.starts_with(edfa + "/status-change[") && kv.first.ends_with("]/alarm-text"); }) == 11);
+        REQUIRE(data[edfa + "/last-changed"] == flapTime);
+    }
+
+    SECTION("Concurrent updates of the same alarm through both RPCs")
+    {
+        // both RPCs are served by threads of their own, and each of them takes its timestamp before the alarm is locked
+        constexpr int ROUNDS = 50;
+        constexpr int BATCH_SIZE = 5;
+        std::atomic<unsigned> failures{0};
+
+        std::thread single([&failures]() {
+            auto sess = TEST_INIT_SESSION;
+            for (int i = 0; i < ROUNDS; ++i) {
+                try {
+                    CLIENT_ALARM_RPC(sess, "alarms-test:alarm-1", "high", "edfa", i % 2 ? "cleared" : "major", "single " + std::to_string(i));
+                } catch (const std::exception&) {
+                    ++failures;
+                }
+            }
+        });
+        std::thread batched([&failures]() {
+            auto sess = TEST_INIT_SESSION;
+            for (int i = 0; i < ROUNDS; ++i) {
+                std::map<std::string, std::string> inp;
+                for (int j = 1; j <= BATCH_SIZE; ++j) {
+                    const auto prefix = "alarm[index='" + std::to_string(j) + "']";
+                    inp[prefix + "/resource"] = "edfa";
+                    inp[prefix + "/alarm-type-id"] = "alarms-test:alarm-1";
+                    inp[prefix + "/alarm-type-qualifier"] = "high";
+                    inp[prefix + "/severity"] = j % 2 ? "critical" : "cleared";
+                    inp[prefix + "/alarm-text"] = "batch " + std::to_string(i) + "/" + std::to_string(j);
+                }
+                try {
+                    auto out = rpcFromSysrepo(*sess, batchRpcPrefix, inp);
+                    failures += std::count_if(out.begin(), out.end(), [](const auto& kv) { return kv.first.ends_with("/result") && kv.second != "ok"; });
+                } catch (const std::exception&) {
+                    ++failures;
+                }
+            }
+        });
+        single.join();
+        batched.join();
+        REQUIRE(failures == 0);
+
+        // the newest status change is the one which describes the current state of the alarm
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational);
+        const auto edfa = "/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']"s;
+        std::optional<std::pair<alarms::TimePoint, std::string>> newest;
+        for (const auto& [path, value] : data) {
+            if (path.starts_with(edfa + "/status-change[") && path.ends_with("]/time")) {
+                const auto time = libyang::fromYangTimeFormat<std::chrono::system_clock>(value);
+                if (!newest || time > newest->first) {
+                    newest = {time, path.substr(0, path.size() - std::string{"/time"}.size())};
+                }
+            }
+        }
+        REQUIRE(newest);
+        REQUIRE(libyang::fromYangTimeFormat<std::chrono::system_clock>(data[edfa + "/last-changed"]) == newest->first);
+        REQUIRE(data[newest->second + "/alarm-text"] == data[edfa + "/alarm-text"]);
+        REQUIRE(data[newest->second + "/perceived-severity"] == (data[edfa + "/is-cleared"] == "true" ? "cleared" : data[edfa + "/perceived-severity"]));
+    }
+}
+
+TEST_CASE("Write-behind publishing")
+{
+    using namespace std::chrono_literals;
+    TEST_SYSREPO_INIT_LOGS;
+
+    copyStartupDatastore("ietf-alarms");
+
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+
+    auto numberOfAlarms = [&]() {
+        return dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational)["/number-of-alarms"];
+    };
+
+    SECTION("Time window")
+    {
+        constexpr auto window = 1s;
+        alarms::Daemon daemon(alarms::WriteBehind{.window = window, .maxPendingUpdates = 1000});
+        CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "", {}, {}, "Any resource");
+
+        const auto sent = std::chrono::steady_clock::now();
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "r1", "major", "first");
+        const auto published = numberOfAlarms();
+        if (std::chrono::steady_clock::now() < sent + window) {
+            // on a slow machine, the window might have expired already
+            REQUIRE(published == "0");
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + 10 * window;
+        while (numberOfAlarms() != "1" && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(30ms);
+        }
+        REQUIRE(numberOfAlarms() == "1");
+    }
+
+    SECTION("Pending updates")
+    {
+        // a window which never expires during the test
+        alarms::Daemon daemon(alarms::WriteBehind{.window = 1h, .maxPendingUpdates = 3});
+        CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "", {}, {}, "Any resource");
+
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "r1", "major", "first");
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "r2", "major", "second");
+        REQUIRE(numberOfAlarms() == "0");
+
+        // too many pending updates, the list is published right away
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "r3", "major", "third");
+        REQUIRE(numberOfAlarms() == "3");
+
+        // purging publishes everything right away as well
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "r4", "major", "fourth");
+        REQUIRE(numberOfAlarms() == "3");
+        CLIENT_PURGE_RPC(userSess, 4, "any", {});
+        REQUIRE(numberOfAlarms() == "0");
+    }
+
+    SECTION("Only the changes are published")
+    {
+        userSess->setItem("/ietf-alarms:alarms/control/max-alarm-status-changes", "2");
+        userSess->applyChanges();
+        alarms::Daemon daemon(alarms::WriteBehind{.window = 1h, .maxPendingUpdates = 3});
+        CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "", {}, {}, "Any resource");
+
+        const auto edfa = "/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='']"s;
+        auto statusChangeTexts = [&](const std::map<std::string, std::string>& data) {
+            std::set<std::string> res;
+            for (const auto& [path, value] : data) {
+                if (path.starts_with(edfa + "/status-change[") && path.ends_with("]/alarm-text")) {
+                    res.insert(value);
+                }
+            }
+            return res;
+        };
+
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "edfa", "major", "1");
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "edfa", "cleared", "2");
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "edfa", "major", "3");
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational);
+        REQUIRE(data[edfa + "/is-cleared"] == "false");
+        REQUIRE(data[edfa + "/alarm-text"] == "3");
+        REQUIRE(statusChangeTexts(data) == std::set<std::string>{"2", "3"});
+
+        // both published entries go away, and so does one entry which was never published
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "edfa", "cleared", "4");
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "edfa", "major", "5");
+        CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", "edfa", "cleared", "6");
+        data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational);
+        REQUIRE(data[edfa + "/is-cleared"] == "true");
+        REQUIRE(data[edfa + "/perceived-severity"] == "major");
+        REQUIRE(data[edfa + "/alarm-text"] == "6");
+        REQUIRE(statusChangeTexts(data) == std::set<std::string>{"5", "6"});
+    }
+}
+
+TEST_CASE("Publishing on demand")
+{
+    TEST_SYSREPO_INIT_LOGS;
+
+    copyStartupDatastore("ietf-alarms");
+
+    auto daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::OnDemand);
+
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+
+    CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "high", {}, {}, "High temperature on any resource with any severity");
+
+    auto edfaTime = CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "high", "edfa", "warning", "Hey, I'm overheating.");
+    auto wssTime = CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "high", "wss", "major", "Melting.");
+
+    REQUIRE(dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational) == PropsWithTimeTest{
+                {"/number-of-alarms", "2"},
+                {"/last-changed", wssTime},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", ""},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-id", "alarms-test:alarm-1"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-qualifier", "high"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/resource", "edfa"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/is-cleared", "false"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/perceived-severity", "warning"},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-text", "Hey, I'm overheating."},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/time-created", edfaTime},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-raised", edfaTime},
+                {"/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-changed", edfaTime},
+                ALARM_STATUS_CHANGE_IMPL("/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", 1, "edfa", "alarms-test:alarm-1", "high", edfaTime, "warning", "Hey, I'm overheating."),
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", ""},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-id", "alarms-test:alarm-1"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-type-qualifier", "high"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/resource", "wss"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/is-cleared", "false"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/perceived-severity", "major"},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/alarm-text", "Melting."},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/time-created", wssTime},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-raised", wssTime},
+                {"/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']/last-changed", wssTime},
+                ALARM_STATUS_CHANGE_IMPL("/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", 2, "wss", "alarms-test:alarm-1", "high", wssTime, "major", "Melting."),
+            });
+
+    SECTION("Only the requested alarm")
+    {
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list/alarm[resource='wss'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", sysrepo::Datastore::Operational);
+        REQUIRE(data["/perceived-severity"] == "major");
+        REQUIRE(data["/alarm-text"] == "Melting.");
+    }
+
+    SECTION("Clearing")
+    {
+        auto clearedTime = CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "high", "edfa", "cleared", "Cooled down.");
+
+        auto data = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list/alarm[resource='edfa'][alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier='high']", sysrepo::Datastore::Operational);
+        REQUIRE(data["/is-cleared"] == "true");
+        REQUIRE(data["/perceived-severity"] == "warning");
+        REQUIRE(data["/last-changed"] == clearedTime);
+        REQUIRE(data["/status-change[time='1']/perceived-severity"] == "warning");
+        REQUIRE(data["/status-change[time='2']/perceived-severity"] == "cleared");
+        REQUIRE(data["/status-change[time='2']/alarm-text"] == "Cooled down.");
+
+        auto summary = dataFromSysrepo(*userSess, "/ietf-alarms:alarms/summary", sysrepo::Datastore::Operational);
+        REQUIRE(summary["/alarm-summary[severity='warning']/total"] == "1");
+        REQUIRE(summary["/alarm-summary[severity='warning']/cleared"] == "1");
+        REQUIRE(summary["/alarm-summary[severity='major']/not-cleared"] == "1");
+        REQUIRE(summary["/alarm-summary[severity='critical']/total"] == "0");
+    }
+
+    SECTION("Purging")
+    {
+        CLIENT_PURGE_RPC(userSess, 2, "any", {});
+        REQUIRE(dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational) == PropsWithTimeTest{
+                    {"/number-of-alarms", "0"},
+                    {"/last-changed", AnyTimeBetween{wssTime.start, std::chrono::system_clock::now()}},
+                });
     }
 }
 
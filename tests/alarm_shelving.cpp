@@ -1,6 +1,8 @@
 #include "trompeloeil_doctest.h"
 #include <chrono>
+#include <cstdlib>
 #include <experimental/iterator>
+#include <filesystem>
 #include <sysrepo-cpp/Connection.hpp>
 #include "alarms/Daemon.h"
 #include "test_alarm_helpers.h"
@@ -547,3 +549,58 @@ TEST_CASE("Alarm shelving")
 
     copyStartupDatastore("ietf-alarms"); // cleanup after last run so we can cleanly uninstall modules
 }
+
+TEST_CASE("Shelving of restored alarms")
+{
+    TEST_SYSREPO_INIT_LOGS;
+
+    copyStartupDatastore("ietf-alarms");
+    const auto stateDirectory = std::filesystem::path{std::getenv("SYSREPO_REPOSITORY_PATH")} / "alarms-state";
+    std::filesystem::remove_all(stateDirectory);
+
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+
+    CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-2-1", "high", {}, {}, "Alarm 1");
+    userSess->setItem("/ietf-alarms:alarms/control/alarm-shelving/shelf[name='shelf']/resource[.='edfa']", std::nullopt);
+    userSess->applyChanges();
+
+    auto daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::Push, alarms::utils::TimeZone::Local, std::nullopt, stateDirectory);
+    CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-2-1", "high", "edfa", "major", "Hey, I'm overheating.");
+    CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-2-1", "high", "wss", "major", "Hey, I'm overheating.");
+    REQUIRE(extractShelvedAlarms(*userSess) == std::vector<ShelvedAlarm>{{{{"alarms-test:alarm-2-1", "high"}, "edfa"}, "shelf"}});
+    REQUIRE(extractAlarms(*userSess) == std::vector<alarms::InstanceKey>{{{"alarms-test:alarm-2-1", "high"}, "wss"}});
+    daemon.reset();
+
+    SECTION("The shelf is removed while the daemon is not running")
+    {
+        userSess->deleteItem("/ietf-alarms:alarms/control/alarm-shelving/shelf[name='shelf']");
+        userSess->applyChanges();
+
+        daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::Push, alarms::utils::TimeZone::Local, std::nullopt, stateDirectory);
+        REQUIRE(extractShelvedAlarms(*userSess).empty());
+        REQUIRE(extractAlarms(*userSess).size() == 2);
+        REQUIRE(dataFromSysrepo(*userSess, "/ietf-alarms:alarms/shelved-alarms", sysrepo::Datastore::Operational)["/number-of-shelved-alarms"] == "0");
+        REQUIRE(dataFromSysrepo(*userSess, "/ietf-alarms:alarms/alarm-list", sysrepo::Datastore::Operational)["/number-of-alarms"] == "2");
+    }
+
+    SECTION("The shelf matches another resource after the restart")
+    {
+        userSess->deleteItem("/ietf-alarms:alarms/control/alarm-shelving/shelf[name='shelf']/resource[.='edfa']");
+        userSess->setItem("/ietf-alarms:alarms/control/alarm-shelving/shelf[name='shelf']/resource[.='wss']", std::nullopt);
+        userSess->applyChanges();
+
+        daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::Push, alarms::utils::TimeZone::Local, std::nullopt, stateDirectory);
+        REQUIRE(extractShelvedAlarms(*userSess) == std::vector<ShelvedAlarm>{{{{"alarms-test:alarm-2-1", "high"}, "wss"}, "shelf"}});
+        REQUIRE(extractAlarms(*userSess) == std::vector<alarms::InstanceKey>{{{"alarms-test:alarm-2-1", "high"}, "edfa"}});
+    }
+
+    SECTION("The shelf stays")
+    {
+        daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::Push, alarms::utils::TimeZone::Local, std::nullopt, stateDirectory);
+        REQUIRE(extractShelvedAlarms(*userSess) == std::vector<ShelvedAlarm>{{{{"alarms-test:alarm-2-1", "high"}, "edfa"}, "shelf"}});
+        REQUIRE(extractAlarms(*userSess) == std::vector<alarms::InstanceKey>{{{"alarms-test:alarm-2-1", "high"}, "wss"}});
+    }
+
+    daemon.reset();
+    std::filesystem::remove_all(stateDirectory);
+}
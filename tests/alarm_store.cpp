@@ -0,0 +1,207 @@
+#include "trompeloeil_doctest.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include "alarms/AlarmStore.h"
+#include "test_alarm_helpers.h"
+#include "test_log_setup.h"
+
+namespace {
+void update(alarms::AlarmEntry& alarm, const alarms::TimePoint now, const int32_t severity, const std::string& text)
+{
+    if (alarm.statusChanges.empty()) {
+        alarm.created = now;
+    }
+    if (severity > 1) {
+        alarm.lastSeverity = severity;
+        if (alarm.statusChanges.empty() || alarm.isCleared) {
+            alarm.lastRaised = now;
+        }
+    }
+    alarm.isCleared = severity == 1;
+    alarm.lastChanged = now;
+    alarm.text = text;
+    alarm.statusChanges.push({now, severity, text});
+}
+
+void requireSame(const alarms::AlarmStore::Alarms& loaded, alarms::AlarmShards& expected)
+{
+    size_t count = 0;
+    for (auto& shard : expected) {
+        shard.alarms.forEach([&](const alarms::InstanceKey& k, const alarms::AlarmEntry& alarm) {
+            ++count;
+            auto it = loaded.find(k);
+            REQUIRE(it != loaded.end());
+            const auto& restored = it->second;
+            REQUIRE(restored.created == alarm.created);
+            REQUIRE(restored.lastRaised == alarm.lastRaised);
+            REQUIRE(restored.lastChanged == alarm.lastChanged);
+            REQUIRE(restored.text == alarm.text);
+            REQUIRE(restored.shelf == alarm.shelf);
+            REQUIRE(restored.lastSeverity == alarm.lastSeverity);
+            REQUIRE(restored.isCleared == alarm.isCleared);
+            REQUIRE(restored.statusChanges.size() == alarm.statusChanges.size());
+            for (size_t i = 0; i < alarm.statusChanges.size(); ++i) {
+                REQUIRE(restored.statusChanges[i].time == alarm.statusChanges[i].time);
+                REQUIRE(restored.statusChanges[i].perceivedSeverity == alarm.statusChanges[i].perceivedSeverity);
+                REQUIRE(restored.statusChanges[i].text == alarm.statusChanges[i].text);
+            }
+        });
+    }
+    REQUIRE(loaded.size() == count);
+}
+}
+
+TEST_CASE("Alarm store")
+{
+    TEST_INIT_LOGS;
+    TemporaryDirectory dir{"test-alarm-store"};
+    const auto epoch = alarms::TimePoint{} + std::chrono::hours{1000};
+    alarms::AlarmShards alarms{4};
+
+    {
+        alarms::AlarmStore store{dir.path};
+        REQUIRE(store.load().empty());
+
+        for (int i = 0; i < 20; ++i) {
+            auto& alarm = alarms.shardFor(testKey(i)).alarms.tryEmplace(testKey(i)).first;
+            update(alarm, epoch + std::chrono::seconds{i}, 2 + i % 5, "initial " + std::to_string(i));
+            if (i % 4 == 0) {
+                alarm.shelf = "shelf";
+            }
+        }
+        store.snapshot(alarms);
+
+        for (int i = 0; i < 20; i += 2) {
+            auto& alarm = *alarms.shardFor(testKey(i)).alarms.find(testKey(i));
+            update(alarm, epoch + std::chrono::seconds{100 + i}, 1, "cleared");
+            store.journalUpdate(testKey(i), alarm, true);
+        }
+
+        // a held update has no new status change
+        auto& held = *alarms.shardFor(testKey(3)).alarms.find(testKey(3));
+        held.text = "held";
+        held.lastChanged = epoch + std::chrono::seconds{200};
+        store.journalUpdate(testKey(3), held, false);
+
+        // compressed
+        auto& compressed = *alarms.shardFor(testKey(4)).alarms.find(testKey(4));
+        compressed.statusChanges.keepNewest(1, [](const auto&) {});
+        store.journalAlarm(testKey(4), compressed);
+
+        // purged
+        alarms.shardFor(testKey(5)).alarms.eraseIf([](const auto& k, const auto&) { return k == testKey(5); });
+        store.journalRemoval(testKey(5));
+
+        // a new one
+        auto& added = alarms.shardFor(testKey(100)).alarms.tryEmplace(testKey(100)).first;
+        update(added, epoch + std::chrono::seconds{300}, 6, "new");
+        store.journalUpdate(testKey(100), added, true);
+
+        store.flush();
+    }
+
+    SECTION("Snapshot and journal")
+    {
+        alarms::AlarmStore store{dir.path};
+        requireSame(store.load(), alarms);
+
+        // the journal continues
+        auto& alarm = *alarms.shardFor(testKey(1)).alarms.find(testKey(1));
+        update(alarm, epoch + std::chrono::seconds{400}, 1, "cleared later");
+        store.journalUpdate(testKey(1), alarm, true);
+        store.flush();
+
+        alarms::AlarmStore again{dir.path};
+        requireSame(again.load(), alarms);
+    }
+
+    SECTION("A new snapshot replaces the journal")
+    {
+        {
+            alarms::AlarmStore store{dir.path};
+            store.load();
+            store.snapshot(alarms);
+        }
+        REQUIRE(std::filesystem::file_size(dir.path / "alarms.journal") == 20);
+
+        alarms::AlarmStore store{dir.path};
+        requireSame(store.load(), alarms);
+    }
+
+    SECTION("Changes while a new snapshot is being written")
+    {
+        std::filesystem::copy_file(dir.path / "alarms.journal", dir.path / "old.journal");
+        {
+            alarms::AlarmStore store{dir.path};
+            store.load();
+            store.snapshot(alarms, [&] {
+                auto& alarm = *alarms.shardFor(testKey(1)).alarms.find(testKey(1));
+                update(alarm, epoch + std::chrono::seconds{700}, 4, "while snapshotting");
+                store.journalUpdate(testKey(1), alarm, true);
+                REQUIRE(!store.snapshotDue());
+            });
+
+            auto& alarm = *alarms.shardFor(testKey(2)).alarms.find(testKey(2));
+            update(alarm, epoch + std::chrono::seconds{800}, 5, "after the snapshot");
+            store.journalUpdate(testKey(2), alarm, true);
+            store.flush();
+        }
+        REQUIRE(!std::filesystem::exists(dir.path / "alarms.journal.new"));
+
+        {
+            alarms::AlarmStore store{dir.path};
+            requireSame(store.load(), alarms);
+        }
+
+        // stopped after replacing the snapshot, but before replacing the journal
+        std::filesystem::rename(dir.path / "alarms.journal", dir.path / "alarms.journal.new");
+        std::filesystem::rename(dir.path / "old.journal", dir.path / "alarms.journal");
+        {
+            alarms::AlarmStore store{dir.path};
+            requireSame(store.load(), alarms);
+        }
+        REQUIRE(!std::filesystem::exists(dir.path / "alarms.journal.new"));
+
+        alarms::AlarmStore store{dir.path};
+        requireSame(store.load(), alarms);
+    }
+
+    SECTION("A torn record at the end of the journal")
+    {
+        {
+            std::ofstream journal{dir.path / "alarms.journal", std::ios::binary | std::ios::app};
+            journal.write("\x40\x00\x00\x00garbage", 11);
+        }
+
+        {
+            alarms::AlarmStore store{dir.path};
+            requireSame(store.load(), alarms);
+
+            // new records follow the valid ones
+            auto& alarm = *alarms.shardFor(testKey(7)).alarms.find(testKey(7));
+            update(alarm, epoch + std::chrono::seconds{500}, 3, "after a crash");
+            store.journalUpdate(testKey(7), alarm, true);
+            store.flush();
+        }
+
+        alarms::AlarmStore store{dir.path};
+        requireSame(store.load(), alarms);
+    }
+
+    SECTION("A journal of an older snapshot")
+    {
+        std::filesystem::copy_file(dir.path / "alarms.journal", dir.path / "old.journal");
+        {
+            alarms::AlarmStore store{dir.path};
+            store.load();
+            auto& alarm = *alarms.shardFor(testKey(1)).alarms.find(testKey(1));
+            update(alarm, epoch + std::chrono::seconds{600}, 5, "newer than the old journal");
+            store.snapshot(alarms);
+        }
+        std::filesystem::copy_file(dir.path / "old.journal", dir.path / "alarms.journal", std::filesystem::copy_options::overwrite_existing);
+
+        alarms::AlarmStore store{dir.path};
+        requireSame(store.load(), alarms);
+    }
+}
@@ -0,0 +1,194 @@
+#include "trompeloeil_doctest.h"
+#include <chrono>
+#include <map>
+#include <random>
+#include <set>
+#include "alarms/AlarmShards.h"
+#include "test_alarm_helpers.h"
+#include "test_log_setup.h"
+
+TEST_CASE("Alarm table")
+{
+    TEST_INIT_LOGS;
+    alarms::AlarmTable table;
+
+    REQUIRE(table.find(testKey(1)) == nullptr);
+
+    auto [first, inserted] = table.tryEmplace(testKey(1));
+    REQUIRE(inserted);
+    first.text = "first";
+
+    // adding many more entries must not move the existing one
+    for (int i = 2; i < 1000; ++i) {
+        table.tryEmplace(testKey(i)).first.text = std::to_string(i);
+    }
+    REQUIRE(table.size() == 999);
+    REQUIRE(&first == table.find(testKey(1)));
+    REQUIRE(first.text == "first");
+
+    auto [again, insertedAgain] = table.tryEmplace(testKey(1));
+    REQUIRE(!insertedAgain);
+    REQUIRE(&again == &first);
+
+    REQUIRE(table.eraseIf([](const auto&, const auto& alarm) { return alarm.text.ends_with('7'); }) == 100);
+    REQUIRE(table.size() == 899);
+    REQUIRE(table.find(testKey(7)) == nullptr);
+    REQUIRE(table.find(testKey(17)) == nullptr);
+    REQUIRE(table.find(testKey(18))->text == "18");
+
+    // slots of the removed entries get reused, and they start from scratch
+    auto [reused, insertedReused] = table.tryEmplace(testKey(7));
+    REQUIRE(insertedReused);
+    REQUIRE(reused.text.empty());
+    REQUIRE(reused.statusChanges.empty());
+
+    size_t visited = 0;
+    table.forEach([&](const alarms::InstanceKey& k, alarms::AlarmEntry& alarm) {
+        ++visited;
+        REQUIRE((k == testKey(7) || alarm.text == (k == testKey(1) ? "first" : k.resource.substr(9))));
+    });
+    REQUIRE(visited == table.size());
+}
+
+TEST_CASE("Alarm table queries")
+{
+    TEST_INIT_LOGS;
+    const auto epoch = alarms::TimePoint{};
+
+    // many alarms share a resource or a type
+    auto gridKey = [](const int i) {
+        return alarms::InstanceKey{.type = {.id = "alarms-test:alarm-" + std::to_string(i / 50), .qualifier = ""}, .resource = "resource-" + std::to_string(i % 50)};
+    };
+
+    std::mt19937 rng{666};
+    auto randomize = [&](alarms::AlarmEntry& alarm) {
+        alarm.lastChanged = epoch + std::chrono::seconds{rng() % 100};
+        alarm.lastSeverity = 2 + rng() % 5;
+        alarm.isCleared = rng() % 2;
+        alarm.shelf = rng() % 4 ? std::nullopt : std::optional<std::string>{"shelf"};
+    };
+
+    auto randomQuery = [&]() {
+        alarms::AlarmQuery query;
+        query.shelved = rng() % 2;
+        if (rng() % 2) {
+            query.isCleared = rng() % 2;
+        }
+        if (rng() % 2) {
+            query.minSeverity = 2 + rng() % 5;
+        }
+        if (rng() % 2) {
+            query.maxSeverity = 2 + rng() % 5;
+        }
+        if (rng() % 2) {
+            // sometimes selective, sometimes not at all
+            query.changedBefore = epoch + std::chrono::seconds{rng() % 2 ? rng() % 5 : rng() % 120};
+        }
+        if (rng() % 3 == 0) {
+            // including the ones which do not exist
+            query.resource = "resource-" + std::to_string(rng() % 60);
+        }
+        if (rng() % 3 == 0) {
+            query.typeId = "alarms-test:alarm-" + std::to_string(rng() % 60);
+        }
+        return query;
+    };
+
+    alarms::AlarmTable table;
+    std::map<alarms::InstanceKey, alarms::AlarmEntry> reference;
+    for (int i = 0; i < 2000; ++i) {
+        auto& alarm = table.tryEmplace(gridKey(i)).first;
+        randomize(alarm);
+        table.reindex(gridKey(i));
+        reference[gridKey(i)] = alarm;
+    }
+
+    for (int round = 0; round < 300; ++round) {
+        // submit: some alarms change or get created
+        for (int i = 0; i < 50; ++i) {
+            const auto k = gridKey(rng() % 2500);
+            auto& alarm = table.tryEmplace(k).first;
+            randomize(alarm);
+            table.reindex(k);
+            reference[k] = alarm;
+        }
+
+        // reshelve: only the shelved flag changes
+        table.forEach([&](const alarms::InstanceKey& k, alarms::AlarmEntry& alarm) {
+            if (rng() % 20 == 0) {
+                alarm.shelf = alarm.shelf ? std::nullopt : std::optional<std::string>{"shelf"};
+                table.reindex(k);
+                reference[k].shelf = alarm.shelf;
+            }
+        });
+
+        // compress: visiting the matching alarms only
+        auto query = randomQuery();
+        std::set<alarms::InstanceKey> visited;
+        table.forEach(query, [&](const alarms::InstanceKey& k, alarms::AlarmEntry&) {
+            REQUIRE(visited.insert(k).second);
+        });
+        std::set<alarms::InstanceKey> expectedVisited;
+        for (const auto& [k, alarm] : reference) {
+            if (query.matches(k, alarms::IndexedAttributes::of(alarm))) {
+                expectedVisited.insert(k);
+            }
+        }
+        REQUIRE(visited == expectedVisited);
+        REQUIRE(table.count(query) == expectedVisited.size());
+
+        // purge
+        query = randomQuery();
+        const auto evenOnly = rng() % 2;
+        auto expected = std::erase_if(reference, [&](const auto& item) {
+            return query.matches(item.first, alarms::IndexedAttributes::of(item.second)) && (!evenOnly || item.first.type.id.back() % 2 == 0);
+        });
+        auto erased = table.eraseIf(query, [&](const alarms::InstanceKey& k, const alarms::AlarmEntry& alarm) {
+            REQUIRE(query.matches(k, alarms::IndexedAttributes::of(alarm)));
+            return !evenOnly || k.type.id.back() % 2 == 0;
+        });
+        REQUIRE(erased == expected);
+        REQUIRE(table.size() == reference.size());
+    }
+
+    for (const auto& [k, alarm] : reference) {
+        REQUIRE(table.find(k) != nullptr);
+        REQUIRE(alarms::IndexedAttributes::of(*table.find(k)) == alarms::IndexedAttributes::of(alarm));
+    }
+}
+
+TEST_CASE("Columnar scan")
+{
+    TEST_INIT_LOGS;
+
+    constexpr size_t NUM_ALARMS = 10'000;
+    const auto epoch = alarms::TimePoint{};
+    std::mt19937 rng{666};
+    alarms::AlarmTable table;
+    for (size_t i = 0; i < NUM_ALARMS; ++i) {
+        auto& alarm = table.tryEmplace(testKey(i)).first;
+        alarm.lastChanged = epoch + std::chrono::seconds{rng() % 1000};
+        alarm.lastSeverity = 2 + rng() % 5;
+        alarm.isCleared = rng() % 2;
+        alarm.shelf = rng() % 10 ? std::nullopt : std::optional<std::string>{"shelf"};
+        table.reindex(testKey(i));
+    }
+    // slots of removed alarms must not show up in the scan
+    table.eraseIf([](const auto&, const auto& alarm) { return alarm.lastSeverity == 6; });
+
+    std::vector<alarms::AlarmQuery> queries(4);
+    queries[1].isCleared = true;
+    queries[1].maxSeverity = 4;
+    queries[2].isCleared = true;
+    queries[2].changedBefore = epoch + std::chrono::seconds{900};
+    queries[3].shelved = true;
+    queries[3].typeId = "alarms-test:alarm-1";
+
+    for (const auto& query : queries) {
+        size_t iterated = 0;
+        table.forEach([&](const alarms::InstanceKey& k, const alarms::AlarmEntry& alarm) {
+            iterated += query.matches(k, alarms::IndexedAttributes::of(alarm));
+        });
+        REQUIRE(table.count(query) == iterated);
+    }
+}
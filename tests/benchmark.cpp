@@ -1,7 +1,19 @@
 #include "trompeloeil_doctest.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/ranges.h>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <string>
 #include <sysrepo-cpp/Connection.hpp>
+#include <thread>
+#include "SYSREPO_IETF_ALARMS_VERSION.h"
+#include "alarms/AlarmStore.h"
 #include "alarms/Daemon.h"
 #include "test_alarm_helpers.h"
 #include "test_log_setup.h"
@@ -10,6 +22,137 @@
 
 using namespace std::string_literals;
 
+namespace {
+std::optional<std::string> env(const char* name)
+{
+    if (auto value = std::getenv(name); value && *value) {
+        return value;
+    }
+    return std::nullopt;
+}
+
+unsigned envNumber(const char* name, const unsigned defaultValue)
+{
+    auto value = env(name);
+    return value ? std::stoul(*value) : defaultValue;
+}
+
+/** @short How large the load is, and what it consists of
+ *
+ * Everything can be set through the environment, e.g.:
+ *
+ *   ALARMS_BENCHMARK_ALARMS=100000 ALARMS_BENCHMARK_MIX=60:30:10 ALARMS_BENCHMARK_JSON=out.json test-benchmark -tc='Load*'
+ * */
+struct LoadSettings {
+    unsigned alarms = envNumber("ALARMS_BENCHMARK_ALARMS", 200); /**< The number of distinct alarms, all of them are raised initially (or restored, on a warm restart) */
+    unsigned updates = envNumber("ALARMS_BENCHMARK_UPDATES", alarms); /**< The number of create-or-update-alarm RPCs after the initial batch */
+    unsigned batchSize = std::max(1u, envNumber("ALARMS_BENCHMARK_BATCH", 100)); /**< Alarms per create-or-update-alarms RPC when raising them initially */
+    std::array<unsigned, 3> mix = parseMix(env("ALARMS_BENCHMARK_MIX").value_or("1:1:1")); /**< Relative weights of raise, severity change, and clear */
+    unsigned shelves = envNumber("ALARMS_BENCHMARK_SHELVES", 0); /**< Shelf N shelves alarms of resource-N */
+    std::optional<std::string> maxAlarmStatusChanges = env("ALARMS_BENCHMARK_HISTORY"); /**< A number, or "infinite"; the YANG default otherwise */
+    unsigned noopPurges = envNumber("ALARMS_BENCHMARK_NOOP_PURGES", 200);
+    unsigned seed = envNumber("ALARMS_BENCHMARK_SEED", 42);
+    std::optional<std::string> json = env("ALARMS_BENCHMARK_JSON"); /**< Where to write the results; the results go to stdout otherwise */
+
+    static std::array<unsigned, 3> parseMix(const std::string& mix)
+    {
+        std::array<unsigned, 3> res;
+        if (std::sscanf(mix.c_str(), "%u:%u:%u", &res[0], &res[1], &res[2]) != 3 || res[0] + res[1] + res[2] == 0) {
+            throw std::invalid_argument{"ALARMS_BENCHMARK_MIX: expected raise:severity-change:clear weights, got \"" + mix + "\""};
+        }
+        return res;
+    }
+};
+
+/** @short Latencies of the individual requests of a single kind */
+struct Operation {
+    std::string name;
+    std::vector<std::chrono::nanoseconds> latencies;
+    size_t items = 0; /**< How many alarms were affected, e.g., a batch RPC counts as many items */
+
+    /** @short Nearest-rank percentile */
+    std::chrono::nanoseconds percentile(const double p) const
+    {
+        auto rank = static_cast<size_t>(std::ceil(p / 100 * latencies.size()));
+        return latencies[std::clamp<size_t>(rank, 1, latencies.size()) - 1];
+    }
+
+    std::chrono::nanoseconds total() const
+    {
+        std::chrono::nanoseconds res{0};
+        for (const auto& latency : latencies) {
+            res += latency;
+        }
+        return res;
+    }
+};
+
+class LoadReport {
+public:
+    explicit LoadReport(const LoadSettings& settings)
+        : m_settings(settings)
+        , m_log(spdlog::get("main"))
+    {
+    }
+
+    /** @short Measure a single request; fn() returns the number of affected alarms */
+    template <typename Fn>
+    void measure(const std::string& name, Fn&& fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        size_t items = fn();
+        auto latency = std::chrono::steady_clock::now() - start;
+
+        auto it = std::find_if(m_operations.begin(), m_operations.end(), [&](const auto& op) { return op.name == name; });
+        if (it == m_operations.end()) {
+            it = m_operations.insert(m_operations.end(), Operation{.name = name, .latencies = {}, .items = 0});
+        }
+        it->latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency));
+        it->items += items;
+    }
+
+    void write()
+    {
+        std::vector<std::string> operations;
+        for (auto& op : m_operations) {
+            std::sort(op.latencies.begin(), op.latencies.end());
+            const auto us = [](const std::chrono::nanoseconds ns) { return ns.count() / 1'000.; };
+            const auto seconds = std::chrono::duration<double>{op.total()}.count();
+            const auto throughput = seconds > 0 ? op.items / seconds : 0.;
+            m_log->error("{}: {} requests, {} alarms, p50 {:.0f}us, p99 {:.0f}us, p999 {:.0f}us, max {:.0f}us, {:.0f} alarms/s",
+                         op.name, op.latencies.size(), op.items, us(op.percentile(50)), us(op.percentile(99)), us(op.percentile(99.9)), us(op.latencies.back()), throughput);
+            operations.push_back(fmt::format(
+                R"({{"name": "{}", "requests": {}, "items": {}, "total-ms": {:.3f}, "throughput-per-s": {:.1f}, )"
+                R"("latency-us": {{"min": {:.1f}, "mean": {:.1f}, "p50": {:.1f}, "p99": {:.1f}, "p999": {:.1f}, "max": {:.1f}}}}})",
+                op.name, op.latencies.size(), op.items, seconds * 1'000, throughput,
+                us(op.latencies.front()), us(op.total()) / op.latencies.size(), us(op.percentile(50)), us(op.percentile(99)), us(op.percentile(99.9)), us(op.latencies.back())));
+        }
+
+        const auto json = fmt::format(
+            R"({{"version": "{}", "settings": {{"alarms": {}, "updates": {}, "batch-size": {}, )"
+            R"("mix": {{"raise": {}, "severity-change": {}, "clear": {}}}, "shelves": {}, "max-alarm-status-changes": "{}", "noop-purges": {}, "seed": {}}}, )"
+            R"("operations": [{}]}})",
+            SYSREPO_IETF_ALARMS_VERSION, m_settings.alarms, m_settings.updates, m_settings.batchSize,
+            m_settings.mix[0], m_settings.mix[1], m_settings.mix[2], m_settings.shelves, m_settings.maxAlarmStatusChanges.value_or("default"), m_settings.noopPurges, m_settings.seed,
+            fmt::join(operations, ", "));
+
+        if (m_settings.json) {
+            std::ofstream{*m_settings.json} << json << std::endl;
+            m_log->error("Results written to {}", *m_settings.json);
+        } else {
+            std::cout << json << std::endl;
+        }
+    }
+
+private:
+    LoadSettings m_settings;
+    alarms::Log m_log;
+    std::vector<Operation> m_operations; /**< In the order of their first appearance */
+};
+
+const std::array<std::string, 4> raisedSeverities{"warning", "minor", "major", "critical"};
+}
+
 TEST_CASE("Basic alarm publishing and updating")
 {
     TEST_SYSREPO_INIT_LOGS;
@@ -19,9 +162,9 @@ TEST_CASE("Basic alarm publishing and updating")
     auto daemon = std::make_unique<alarms::Daemon>();
     TEST_SYSREPO_CLIENT_INIT(userSess);
 
-    constexpr auto NUM_RESOURCES = 200;
-    constexpr auto FAILING_RESOURCES = 200;
-    constexpr auto NOOP_PURGES = 200;
+    const LoadSettings settings;
+    const auto NUM_RESOURCES = static_cast<int>(settings.alarms);
+    const auto FAILING_RESOURCES = static_cast<int>(settings.alarms);
 
     SECTION("inventory: sequential resources") {
         auto start = std::chrono::steady_clock::now();
@@ -61,13 +204,27 @@ TEST_CASE("Basic alarm publishing and updating")
             mainLog->error("Sending {} alarms: {}ms", FAILING_RESOURCES, ms);
         }
 
-        if (0) { // FIXME: re-enable this once we're interested in measuring sysrepo's overhead for calling actions
-            auto start = std::chrono::steady_clock::now();
-            for (int i = 0; i < NOOP_PURGES; ++i) {
-                CLIENT_PURGE_RPC(userSess, 0, "cleared", ({{"severity/below", "indeterminate"}}));
+        {
+            std::vector<std::tuple<std::string, std::string, std::string, std::string, std::string>> batch;
+            for (int i = 0; i < FAILING_RESOURCES; ++i) {
+                batch.emplace_back("alarms-test:alarm-1", "", "resource-" + std::to_string(i), "critical", "yyy");
+            }
+            std::map<std::string, std::string> expected;
+            unsigned index = 0;
+            for (const auto& [id, qualifier, resource, severity, text] : batch) {
+                const auto prefix = "/alarm[index='" + std::to_string(++index) + "']";
+                expected[prefix] = "";
+                expected[prefix + "/index"] = std::to_string(index);
+                expected[prefix + "/resource"] = resource;
+                expected[prefix + "/alarm-type-id"] = id;
+                expected[prefix + "/alarm-type-qualifier"] = qualifier;
+                expected[prefix + "/result"] = "ok";
             }
+
+            auto start = std::chrono::steady_clock::now();
+            CLIENT_ALARM_BATCH_RPC(userSess, (batch), (expected));
             auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
-            mainLog->error("Issuing {} purge requests which don't purge anything: {}ms", NOOP_PURGES, ms);
+            mainLog->error("Updating {} alarms in a single batch: {}ms", FAILING_RESOURCES, ms);
         }
 
         {
@@ -78,3 +235,203 @@ TEST_CASE("Basic alarm publishing and updating")
         }
     }
 }
+
+TEST_CASE("Load with a mix of updates")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    spdlog::get("main")->set_level(spdlog::level::info);
+    copyStartupDatastore("ietf-alarms");
+    const LoadSettings settings;
+    LoadReport report{settings};
+    std::mt19937 random{settings.seed};
+
+    auto daemon = std::make_unique<alarms::Daemon>();
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+    for (unsigned i = 0; i < settings.shelves; ++i) {
+        userSess->setItem(controlShelf + "[name='shelf-"s + std::to_string(i) + "']/resource[.='resource-" + std::to_string(i) + "']", std::nullopt);
+    }
+    if (settings.maxAlarmStatusChanges) {
+        userSess->setItem("/ietf-alarms:alarms/control/max-alarm-status-changes", *settings.maxAlarmStatusChanges);
+    }
+    userSess->applyChanges();
+
+    CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "", {}, {}, "desc");
+    const auto shelvedAlarms = std::min(settings.shelves, settings.alarms);
+    const auto resource = [](const unsigned i) { return "resource-" + std::to_string(i); };
+    const auto rpcTimeout = std::chrono::milliseconds{600'000};
+
+    // the alarms which are cleared, the rest of them has been raised with the specified severity
+    std::vector<std::optional<std::string>> severities(settings.alarms);
+    auto randomSeverity = [&]() { return raisedSeverities[std::uniform_int_distribution<size_t>{0, raisedSeverities.size() - 1}(random)]; };
+
+    for (unsigned first = 0; first < settings.alarms; first += settings.batchSize) {
+        const auto last = std::min(first + settings.batchSize, settings.alarms);
+        std::map<std::string, std::string> input;
+        for (auto i = first; i < last; ++i) {
+            severities[i] = randomSeverity();
+            const auto prefix = "alarm[index='" + std::to_string(i) + "']";
+            input[prefix + "/resource"] = resource(i);
+            input[prefix + "/alarm-type-id"] = "alarms-test:alarm-1";
+            input[prefix + "/severity"] = *severities[i];
+            input[prefix + "/alarm-text"] = "Something is wrong with " + resource(i);
+        }
+        std::map<std::string, std::string> output;
+        report.measure("create-or-update-alarms", [&]() {
+            output = rpcFromSysrepo(*userSess, batchRpcPrefix, input, rpcTimeout);
+            return last - first;
+        });
+        REQUIRE(static_cast<unsigned>(std::count_if(output.begin(), output.end(), [](const auto& kv) { return kv.first.ends_with("/result") && kv.second == "ok"; })) == last - first);
+    }
+
+    /* Pick a random alarm in the desired state. The mix can run out of them (e.g., when it is all clears),
+     * so the search gives up after a few attempts and the update goes through on whatever alarm is at hand. */
+    auto pickAlarm = [&](const bool cleared) {
+        std::uniform_int_distribution<unsigned> alarm{0, settings.alarms - 1};
+        auto i = alarm(random);
+        for (int attempt = 0; attempt < 10 && !!severities[i] == cleared; ++attempt) {
+            i = alarm(random);
+        }
+        return i;
+    };
+
+    std::discrete_distribution<int> mix{settings.mix.begin(), settings.mix.end()};
+    for (unsigned update = 0; update < settings.updates && settings.alarms; ++update) {
+        std::string operation;
+        unsigned i;
+        switch (mix(random)) {
+        case 0:
+            operation = "raise";
+            i = pickAlarm(true);
+            severities[i] = randomSeverity();
+            break;
+        case 1:
+            operation = "severity-change";
+            i = pickAlarm(false);
+            {
+                auto severity = randomSeverity();
+                while (severity == severities[i]) {
+                    severity = randomSeverity();
+                }
+                severities[i] = severity;
+            }
+            break;
+        default:
+            operation = "clear";
+            i = pickAlarm(false);
+            severities[i] = std::nullopt;
+            break;
+        }
+        report.measure(operation, [&]() {
+            CLIENT_ALARM_RPC(userSess, "alarms-test:alarm-1", "", resource(i), severities[i].value_or("cleared"), "Update #" + std::to_string(update));
+            return 1;
+        });
+    }
+
+    for (unsigned i = 0; i < settings.noopPurges; ++i) {
+        report.measure("purge-alarms (no-op)", [&]() {
+            CLIENT_PURGE_RPC(userSess, 0, "cleared", ({{"severity/below", "indeterminate"}}));
+            return 0;
+        });
+    }
+
+    report.measure("compress-alarms", [&]() {
+        return std::stoul(rpcFromSysrepo(*userSess, compressAlarmsRpcPrefix, {}, rpcTimeout).at("/compressed-alarms"));
+    });
+
+    report.measure("purge-alarms", [&]() {
+        CLIENT_PURGE_RPC_SLOW(userSess, settings.alarms - shelvedAlarms, "any", {}, rpcTimeout);
+        return settings.alarms - shelvedAlarms;
+    });
+    report.measure("purge-shelved-alarms", [&]() {
+        CLIENT_PURGE_RPC_IMPL(userSess, purgeShelvedRpcPrefix, shelvedAlarms, "any", {}, rpcTimeout);
+        return shelvedAlarms;
+    });
+
+    report.write();
+}
+
+TEST_CASE("Multiple producers")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    spdlog::get("main")->set_level(spdlog::level::info);
+    auto mainLog = spdlog::get("main");
+    copyStartupDatastore("ietf-alarms");
+    auto daemon = std::make_unique<alarms::Daemon>();
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+
+    constexpr auto ALARMS_PER_PRODUCER = 200;
+    const auto cores = std::max(1u, std::thread::hardware_concurrency());
+
+    CLIENT_INTRODUCE_ALARM(userSess, "alarms-test:alarm-1", "", {}, {}, "desc");
+
+    size_t total = 0;
+    for (unsigned producers = 1; producers <= cores; producers *= 2) {
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned producer = 0; producer < producers; ++producer) {
+            threads.emplace_back([producer, producers]() {
+                auto sess = TEST_INIT_SESSION;
+                for (int i = 0; i < ALARMS_PER_PRODUCER; ++i) {
+                    CLIENT_ALARM_RPC(sess, "alarms-test:alarm-1", "", "producer-" + std::to_string(producers) + "-" + std::to_string(producer) + "-" + std::to_string(i), "critical", "text");
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        mainLog->error("{} producers, {} alarms each: {}ms ({} alarms/s)", producers, ALARMS_PER_PRODUCER, ms, producers * ALARMS_PER_PRODUCER * 1000 / std::max<decltype(ms)>(ms, 1));
+        total += producers * ALARMS_PER_PRODUCER;
+    }
+
+    REQUIRE(listInstancesFromSysrepo(*userSess, alarmListInstances, sysrepo::Datastore::Operational).size() == total);
+}
+
+TEST_CASE("Warm restart")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    spdlog::get("main")->set_level(spdlog::level::info);
+    auto mainLog = spdlog::get("main");
+    copyStartupDatastore("ietf-alarms");
+    const auto stateDirectory = std::filesystem::path{std::getenv("SYSREPO_REPOSITORY_PATH")} / "alarms-state";
+    std::filesystem::remove_all(stateDirectory);
+
+    const LoadSettings settings;
+    const auto NUM_ALARMS = settings.alarms;
+
+    {
+        // what the previous run of the daemon has left behind
+        const auto now = std::chrono::system_clock::now();
+        alarms::AlarmShards alarms{1};
+        for (unsigned i = 0; i < NUM_ALARMS; ++i) {
+            const alarms::InstanceKey key{.type = {.id = "alarms-test:alarm-1", .qualifier = ""}, .resource = "resource-" + std::to_string(i)};
+            auto& alarm = alarms.shardFor(key).alarms.tryEmplace(key).first;
+            alarm.created = alarm.lastRaised = alarm.lastChanged = now;
+            alarm.text = "Something is wrong with resource " + std::to_string(i);
+            alarm.lastSeverity = 6; // critical
+            alarm.statusChanges.push({now, alarm.lastSeverity, alarm.text});
+        }
+        alarms::AlarmStore store{stateDirectory};
+        store.load();
+        store.snapshot(alarms);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::Push, alarms::utils::TimeZone::Local, std::nullopt, stateDirectory);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    mainLog->error("Starting with {} persisted alarms: {}ms", NUM_ALARMS, ms);
+
+    TEST_SYSREPO_CLIENT_INIT(userSess);
+    REQUIRE(listInstancesFromSysrepo(*userSess, alarmListInstances, sysrepo::Datastore::Operational).size() == NUM_ALARMS);
+
+    start = std::chrono::steady_clock::now();
+    daemon.reset();
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    mainLog->error("Stopping with {} alarms: {}ms", NUM_ALARMS, ms);
+
+    start = std::chrono::steady_clock::now();
+    daemon = std::make_unique<alarms::Daemon>(std::nullopt, alarms::Publishing::Push, alarms::utils::TimeZone::Local, std::nullopt, stateDirectory);
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    mainLog->error("Restarting with {} alarms: {}ms", NUM_ALARMS, ms);
+    REQUIRE(listInstancesFromSysrepo(*userSess, alarmListInstances, sysrepo::Datastore::Operational).size() == NUM_ALARMS);
+}
@@ -0,0 +1,584 @@
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <libyang-cpp/Context.hpp>
+#include <random>
+#include <spdlog/sinks/null_sink.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SYSREPO_IETF_ALARMS_VERSION.h"
+#include "alarms/AlarmEngine.h"
+#include "alarms/AlarmEntry.h"
+#include "alarms/AlarmShards.h"
+#include "alarms/AlarmStore.h"
+#include "alarms/Filters.h"
+#include "alarms/Identities.h"
+#include "alarms/Key.h"
+#include "alarms/ShelfMatch.h"
+#include "utils/log-init.h"
+#include "utils/time.h"
+#include "test_alarm_helpers.h"
+
+using namespace std::string_literals;
+
+namespace {
+constexpr size_t NUM_KEYS = 1024; // a power of two, so that cycling through the keys is cheap
+const auto shelves = "/ietf-alarms:alarms/control/alarm-shelving/shelf"s;
+
+std::vector<alarms::InstanceKey> keys()
+{
+    std::vector<alarms::InstanceKey> res;
+    for (size_t i = 0; i < NUM_KEYS; ++i) {
+        res.push_back(testKey(i));
+    }
+    return res;
+}
+
+std::vector<alarms::InstanceKey> manyKeys(const int64_t size)
+{
+    std::vector<alarms::InstanceKey> res;
+    for (int64_t i = 0; i < size; ++i) {
+        res.push_back(testKey(i));
+    }
+    return res;
+}
+
+std::vector<alarms::AlarmEntry> alarmEntries()
+{
+    const auto epoch = alarms::TimePoint{} + std::chrono::hours{1000};
+    std::vector<alarms::AlarmEntry> res(NUM_KEYS);
+    for (size_t i = 0; i < NUM_KEYS; ++i) {
+        res[i].lastSeverity = 2 + i % 5;
+        res[i].isCleared = i % 3 == 0;
+        res[i].lastChanged = epoch + std::chrono::minutes{i};
+    }
+    return res;
+}
+
+/** @short The ietf-alarms schema along with the test alarm identities, without any sysrepo */
+struct Schema {
+    libyang::Context ctx;
+    alarms::IdentityTable identities;
+
+    Schema()
+        : ctx(std::string{CMAKE_CURRENT_SOURCE_DIR} + "/yang", libyang::ContextOptions::NoYangLibrary)
+    {
+        ctx.setSearchDir(std::string{CMAKE_CURRENT_SOURCE_DIR} + "/tests/yang");
+        ctx.loadModule("ietf-alarms", "2019-09-11", {"alarm-shelving", "alarm-summary", "alarm-history"});
+        ctx.loadModule("alarms-test");
+        identities.update(ctx);
+    }
+
+    static const Schema& get()
+    {
+        static const Schema schema;
+        return schema;
+    }
+};
+
+void BM_TypeHashValue(benchmark::State& state)
+{
+    const auto input = keys();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hash_value(input[i++ % NUM_KEYS].type));
+    }
+}
+BENCHMARK(BM_TypeHashValue);
+
+void BM_InstanceKeyHashValue(benchmark::State& state)
+{
+    const auto input = keys();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hash_value(input[i++ % NUM_KEYS]));
+    }
+}
+BENCHMARK(BM_InstanceKeyHashValue);
+
+/** @short What the hash containers of alarms actually call */
+void BM_InstanceKeyBoostHash(benchmark::State& state)
+{
+    const auto input = keys();
+    const boost::hash<alarms::InstanceKey> hasher;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hasher(input[i++ % NUM_KEYS]));
+    }
+}
+BENCHMARK(BM_InstanceKeyBoostHash);
+
+void BM_InstanceKeyXPathIndex(benchmark::State& state)
+{
+    const auto input = keys();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(input[i++ % NUM_KEYS].xpathIndex());
+    }
+}
+BENCHMARK(BM_InstanceKeyXPathIndex);
+
+/** @short A node-based hash map, the baseline for the AlarmTable */
+using NodeBasedMap = std::unordered_map<alarms::InstanceKey, alarms::AlarmEntry, boost::hash<alarms::InstanceKey>>;
+
+void emplace(alarms::AlarmTable& table, const alarms::InstanceKey& k)
+{
+    table.tryEmplace(k);
+}
+
+void emplace(NodeBasedMap& map, const alarms::InstanceKey& k)
+{
+    map.try_emplace(k);
+}
+
+bool contains(alarms::AlarmTable& table, const alarms::InstanceKey& k)
+{
+    return table.find(k);
+}
+
+bool contains(NodeBasedMap& map, const alarms::InstanceKey& k)
+{
+    return map.contains(k);
+}
+
+void eraseAll(alarms::AlarmTable& table, const std::vector<alarms::InstanceKey>&)
+{
+    table.eraseIf([](const auto&, const auto&) { return true; });
+}
+
+void eraseAll(NodeBasedMap& map, const std::vector<alarms::InstanceKey>& keys)
+{
+    for (const auto& k : keys) {
+        map.erase(k);
+    }
+}
+
+/** @short Fill an empty table, including its destruction */
+template <typename Table>
+void BM_TableInsert(benchmark::State& state)
+{
+    const auto input = manyKeys(state.range(0));
+    for (auto _ : state) {
+        Table table;
+        for (const auto& k : input) {
+            emplace(table, k);
+        }
+        benchmark::DoNotOptimize(table);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_TableInsert, alarms::AlarmTable)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+BENCHMARK_TEMPLATE(BM_TableInsert, NodeBasedMap)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+
+/** @short Look up existing keys in a random order */
+template <typename Table>
+void BM_TableFind(benchmark::State& state)
+{
+    auto input = manyKeys(state.range(0));
+    Table table;
+    for (const auto& k : input) {
+        emplace(table, k);
+    }
+    std::shuffle(input.begin(), input.end(), std::mt19937{666});
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(contains(table, input[i++ % input.size()]));
+    }
+}
+BENCHMARK_TEMPLATE(BM_TableFind, alarms::AlarmTable)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+BENCHMARK_TEMPLATE(BM_TableFind, NodeBasedMap)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+
+/** @short Remove all entries; the AlarmTable does so in one pass, the baseline erases the keys in a random order */
+template <typename Table>
+void BM_TableEraseAll(benchmark::State& state)
+{
+    auto input = manyKeys(state.range(0));
+    std::shuffle(input.begin(), input.end(), std::mt19937{666});
+    Table table;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (const auto& k : input) {
+            emplace(table, k);
+        }
+        state.ResumeTiming();
+        eraseAll(table, input);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_TableEraseAll, alarms::AlarmTable)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+BENCHMARK_TEMPLATE(BM_TableEraseAll, NodeBasedMap)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+
+/** @short Alarms with random indexed attributes */
+void fillRandomly(alarms::AlarmTable& table, const int64_t size)
+{
+    const auto epoch = alarms::TimePoint{};
+    std::mt19937 rng{666};
+    for (int64_t i = 0; i < size; ++i) {
+        auto& alarm = table.tryEmplace(testKey(i)).first;
+        alarm.lastChanged = epoch + std::chrono::seconds{rng() % 1000};
+        alarm.lastSeverity = 2 + rng() % 5;
+        alarm.isCleared = rng() % 2;
+        alarm.shelf = rng() % 10 ? std::nullopt : std::optional<std::string>{"shelf"};
+        table.reindex(testKey(i));
+    }
+}
+
+/** @short 0: all unshelved alarms, 1: cleared ones below major, 2: cleared ones which are older than some time */
+alarms::AlarmQuery columnarQuery(const int64_t which)
+{
+    alarms::AlarmQuery query;
+    if (which == 1) {
+        query.isCleared = true;
+        query.maxSeverity = 4;
+    } else if (which == 2) {
+        query.isCleared = true;
+        query.changedBefore = alarms::TimePoint{} + std::chrono::seconds{900};
+    }
+    return query;
+}
+
+void BM_AlarmTableCount(benchmark::State& state)
+{
+    alarms::AlarmTable table;
+    fillRandomly(table, 1'000'000);
+    const auto query = columnarQuery(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(table.count(query));
+    }
+    state.SetItemsProcessed(state.iterations() * table.size());
+}
+BENCHMARK(BM_AlarmTableCount)->ArgName("query")->DenseRange(0, 2);
+
+/** @short Evaluating the same queries entry by entry, as a baseline for the columnar scan */
+void BM_AlarmTableForEachMatches(benchmark::State& state)
+{
+    alarms::AlarmTable table;
+    fillRandomly(table, 1'000'000);
+    const auto query = columnarQuery(state.range(0));
+    for (auto _ : state) {
+        size_t matching = 0;
+        table.forEach([&](const alarms::InstanceKey& k, const alarms::AlarmEntry& alarm) {
+            matching += query.matches(k, alarms::IndexedAttributes::of(alarm));
+        });
+        benchmark::DoNotOptimize(matching);
+    }
+    state.SetItemsProcessed(state.iterations() * table.size());
+}
+BENCHMARK(BM_AlarmTableForEachMatches)->ArgName("query")->DenseRange(0, 2);
+
+/** @short A directory for the alarm store, removed once the benchmark is done */
+constexpr int STATUS_CHANGES = 8;
+
+/** @short Alarms which went through STATUS_CHANGES raises and clears each */
+void fillWithHistory(alarms::AlarmShards& shards, const int64_t size)
+{
+    const auto epoch = alarms::TimePoint{} + std::chrono::hours{1000};
+    for (int64_t i = 0; i < size; ++i) {
+        auto& alarm = shards.shardFor(testKey(i)).alarms.tryEmplace(testKey(i)).first;
+        const auto text = "Something is wrong with resource " + std::to_string(i);
+        for (int j = 0; j < STATUS_CHANGES; ++j) {
+            alarm.update(j > 0, epoch + std::chrono::seconds{i + j}, j % 2 ? alarms::ClearedSeverity : 5, text, std::nullopt, alarms::NotifyStatusChanges::All, std::nullopt, std::nullopt, false);
+        }
+    }
+}
+
+void BM_AlarmStoreSnapshot(benchmark::State& state)
+{
+    TemporaryDirectory dir{"benchmark-alarm-store"};
+    alarms::AlarmShards shards{16};
+    fillWithHistory(shards, state.range(0));
+    alarms::AlarmStore store{dir.path};
+    store.load();
+    for (auto _ : state) {
+        store.snapshot(shards);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["bytes"] = std::filesystem::file_size(dir.path / "alarms.snapshot");
+}
+BENCHMARK(BM_AlarmStoreSnapshot)->Arg(10'000)->Arg(100'000);
+
+/** @short Journal one more status change of an existing alarm */
+void BM_AlarmStoreJournalUpdate(benchmark::State& state)
+{
+    TemporaryDirectory dir{"benchmark-alarm-store"};
+    alarms::AlarmShards shards{16};
+    fillWithHistory(shards, NUM_KEYS);
+    alarms::AlarmStore store{dir.path};
+    store.load();
+    store.snapshot(shards);
+
+    auto now = alarms::TimePoint{} + std::chrono::hours{2000};
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto k = testKey(i++ % NUM_KEYS);
+        auto& alarm = *shards.shardFor(k).alarms.find(k);
+        now += std::chrono::seconds{1};
+        alarm.update(true, now, alarm.isCleared ? 4 : alarms::ClearedSeverity, "One more update", std::nullopt, alarms::NotifyStatusChanges::All, std::nullopt, std::nullopt, false);
+        store.journalUpdate(k, alarm, true);
+    }
+    store.flush();
+}
+BENCHMARK(BM_AlarmStoreJournalUpdate);
+
+/** @short Restore the alarms from a snapshot, and from a journal with one update of each alarm on top of it */
+void BM_AlarmStoreLoad(benchmark::State& state)
+{
+    TemporaryDirectory dir{"benchmark-alarm-store"};
+    {
+        alarms::AlarmShards shards{16};
+        fillWithHistory(shards, state.range(0));
+        alarms::AlarmStore store{dir.path};
+        store.load();
+        store.snapshot(shards);
+        const auto now = alarms::TimePoint{} + std::chrono::hours{2000};
+        for (auto& shard : shards) {
+            shard.alarms.forEach([&](const alarms::InstanceKey& k, alarms::AlarmEntry& alarm) {
+                alarm.update(true, now, 4, "One more update", std::nullopt, alarms::NotifyStatusChanges::All, std::nullopt, std::nullopt, false);
+                store.journalUpdate(k, alarm, true);
+            });
+        }
+        store.flush();
+    }
+
+    for (auto _ : state) {
+        alarms::AlarmStore store{dir.path};
+        benchmark::DoNotOptimize(store.load());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AlarmStoreLoad)->Arg(10'000)->Arg(100'000);
+
+/** @short The alarm engine only, without anyone listening to its events */
+struct NoEvents : alarms::AlarmEngine::Events {
+    void alarmUpdated(const alarms::InstanceKey&, const alarms::AlarmEntry&, const alarms::AlarmEngine::AlarmChange&) override { }
+    void alarmRemoved(const alarms::InstanceKey&, const alarms::AlarmEntry&) override { }
+    void statusChangeRemoved(const alarms::InstanceKey&, const alarms::AlarmEntry&, const alarms::TimePoint&) override { }
+    void alarmReshelved(const alarms::InstanceKey&, const alarms::AlarmEntry&, const std::optional<std::string>&) override { }
+};
+
+NoEvents noEvents;
+std::unique_ptr<alarms::AlarmEngine> sharedEngine; /**< Shared by all threads of a benchmark, set up by the first one */
+
+/** @short Raise and clear existing alarms; each thread updates its own subset of them */
+void BM_AlarmEngineUpdate(benchmark::State& state)
+{
+    const auto epoch = alarms::TimePoint{} + std::chrono::hours{1000};
+    if (state.thread_index() == 0) {
+        sharedEngine = std::make_unique<alarms::AlarmEngine>(noEvents);
+        sharedEngine->reconfigure({.notifyStatusChanges = alarms::NotifyStatusChanges::All, .notifySeverityThreshold = std::nullopt, .maxAlarmStatusChanges = 32}, std::nullopt);
+        for (size_t i = 0; i < NUM_KEYS; ++i) {
+            sharedEngine->update(epoch, {.key = testKey(i), .severity = 5, .text = "text"});
+        }
+    }
+
+    auto input = keys();
+    auto now = epoch;
+    size_t i = state.thread_index();
+    for (auto _ : state) {
+        now += std::chrono::seconds{1};
+        // every pass over the keys flips all alarms between raised and cleared
+        const int32_t severity = (i / NUM_KEYS) % 2 ? 5 : alarms::ClearedSeverity;
+        benchmark::DoNotOptimize(sharedEngine->update(now, {.key = input[i % NUM_KEYS], .severity = severity, .text = "text"}));
+        i += state.threads();
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        sharedEngine.reset();
+    }
+}
+BENCHMARK(BM_AlarmEngineUpdate)->Threads(1)->Threads(2)->Threads(4)->Threads(8)->UseRealTime();
+
+void BM_AlarmEnginePurge(benchmark::State& state)
+{
+    const auto epoch = alarms::TimePoint{} + std::chrono::hours{1000};
+    alarms::AlarmEngine engine{noEvents};
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            engine.update(epoch, {.key = testKey(i), .severity = static_cast<int32_t>(2 + i % 5), .text = "text"});
+        }
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(engine.purge(alarms::AlarmFilter{}, false, epoch + std::chrono::hours{1}));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AlarmEnginePurge)->Arg(10'000)->Arg(100'000);
+
+void BM_PurgeFilterMatches(benchmark::State& state)
+{
+    const auto rpc = "/ietf-alarms:alarms/alarm-list/purge-alarms"s;
+    auto input = Schema::get().ctx.newPath(rpc + "/alarm-clearance-status", "cleared");
+    input.newPath(rpc + "/severity/above", "minor");
+    input.newPath(rpc + "/older-than/hours", "1");
+    const alarms::PurgeFilter filter{*input.findPath(rpc)};
+
+    const auto k = keys();
+    const auto entries = alarmEntries();
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto index = i++ % NUM_KEYS;
+        benchmark::DoNotOptimize(filter.matches(k[index], entries[index]));
+    }
+}
+BENCHMARK(BM_PurgeFilterMatches);
+
+void BM_CompressFilterMatches(benchmark::State& state)
+{
+    const auto rpc = "/ietf-alarms:alarms/alarm-list/compress-alarms"s;
+    auto input = Schema::get().ctx.newPath(rpc + "/resource", "resource-42");
+    input.newPath(rpc + "/alarm-type-id", "alarms-test:alarm-1");
+    input.newPath(rpc + "/alarm-type-qualifier", "");
+    const alarms::CompressFilter filter{*input.findPath(rpc)};
+
+    const auto k = keys();
+    const auto entries = alarmEntries();
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto index = i++ % NUM_KEYS;
+        benchmark::DoNotOptimize(filter.matches(k[index], entries[index]));
+    }
+}
+BENCHMARK(BM_CompressFilterMatches);
+
+/** @short Shelves with a single resource each, and one more shelf which matches a qualified type on any resource */
+libyang::DataNode shelvingConfig(const libyang::Context& ctx, const int64_t numShelves)
+{
+    auto config = ctx.newPath("/ietf-alarms:alarms/control/alarm-shelving");
+    for (int64_t i = 0; i < numShelves; ++i) {
+        const auto prefix = shelves + "[name='shelf-" + std::to_string(i) + "']";
+        config.newPath(prefix + "/resource[.='resource-" + std::to_string(i) + "']");
+        config.newPath(prefix + "/alarm-type[alarm-type-id='alarms-test:alarm-2'][alarm-type-qualifier-match='']");
+    }
+    config.newPath(shelves + "[name='qualified']/alarm-type[alarm-type-id='alarms-test:alarm-1'][alarm-type-qualifier-match='shelve-me']");
+    return config;
+}
+
+void BM_CompileShelvingRules(benchmark::State& state)
+{
+    const auto& schema = Schema::get();
+    const auto config = shelvingConfig(schema.ctx, state.range(0));
+    const auto shelfNodes = config.findXPath(shelves);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(alarms::ShelvingRules{shelfNodes, schema.identities});
+    }
+}
+BENCHMARK(BM_CompileShelvingRules)->Arg(10)->Arg(100)->Arg(1000)->Arg(10'000);
+
+/** @short Alarms on distinct resources against shelvingConfig() */
+void BM_FindMatchingShelf(benchmark::State& state)
+{
+    const auto& schema = Schema::get();
+    const auto config = shelvingConfig(schema.ctx, state.range(0));
+    const alarms::ShelvingRules rules{config.findXPath(shelves), schema.identities};
+
+    auto input = keys();
+    for (auto& k : input) {
+        k.type.identity = schema.identities.find(k.type.id);
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(rules.findMatchingShelf(input[i++ % NUM_KEYS], schema.identities));
+    }
+}
+BENCHMARK(BM_FindMatchingShelf)->Arg(0)->Arg(10)->Arg(100)->Arg(1000)->Arg(10'000);
+
+/** @short Raise and clear an existing alarm with a full status-change history, so that each update evicts the oldest change */
+void BM_AlarmEntryUpdate(benchmark::State& state)
+{
+    const auto limit = static_cast<uint16_t>(state.range(0));
+    auto now = alarms::TimePoint{} + std::chrono::hours{1000};
+    const std::string text = "Something is wrong with resource-42";
+    alarms::AlarmEntry alarm;
+    alarm.update(false, now, 5, text, std::nullopt, alarms::NotifyStatusChanges::All, std::nullopt, limit, false);
+    for (uint16_t i = 0; i < limit; ++i) {
+        now += std::chrono::seconds{1};
+        alarm.update(true, now, i % 2 ? 5 : alarms::ClearedSeverity, text, std::nullopt, alarms::NotifyStatusChanges::All, std::nullopt, limit, false);
+    }
+
+    for (auto _ : state) {
+        now += std::chrono::seconds{1};
+        benchmark::DoNotOptimize(alarm.update(true, now, alarm.isCleared ? 5 : alarms::ClearedSeverity, text, std::nullopt, alarms::NotifyStatusChanges::All, std::nullopt, limit, false));
+    }
+}
+BENCHMARK(BM_AlarmEntryUpdate)->Arg(16)->Arg(1024);
+
+/** @short Lower the max-alarm-status-changes of an alarm with a full history to one half */
+void BM_StatusChangeHistoryShrink(benchmark::State& state)
+{
+    const auto limit = static_cast<uint16_t>(state.range(0));
+    const auto epoch = alarms::TimePoint{} + std::chrono::hours{1000};
+    size_t evicted = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        alarms::StatusChangeHistory history;
+        history.setLimit(limit, [](const alarms::TimePoint&) {});
+        for (uint16_t i = 0; i < limit + limit / 2; ++i) {
+            history.push({epoch + std::chrono::seconds{i}, i % 2 ? 5 : alarms::ClearedSeverity, "text"});
+        }
+        state.ResumeTiming();
+
+        history.setLimit(limit / 2, [&](const alarms::TimePoint&) { ++evicted; });
+        benchmark::DoNotOptimize(history);
+    }
+    state.counters["evicted"] = benchmark::Counter(evicted, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_StatusChangeHistoryShrink)->Arg(16)->Arg(1024);
+
+void BM_YangTimeFormatter(benchmark::State& state)
+{
+    const alarms::utils::YangTimeFormatter formatter{state.range(0) ? alarms::utils::TimeZone::Local : alarms::utils::TimeZone::UTC};
+    auto time = std::chrono::system_clock::now();
+    alarms::utils::YangTimeFormatter::Buffer buffer;
+    for (auto _ : state) {
+        time += std::chrono::milliseconds{1};
+        benchmark::DoNotOptimize(formatter.format(time, buffer));
+    }
+}
+BENCHMARK(BM_YangTimeFormatter)->ArgName("local")->Arg(0)->Arg(1);
+
+/** @short The generic formatter which YangTimeFormatter replaces, as a baseline */
+void BM_LibyangYangTimeFormat(benchmark::State& state)
+{
+    auto time = std::chrono::system_clock::now();
+    for (auto _ : state) {
+        time += std::chrono::milliseconds{1};
+        benchmark::DoNotOptimize(libyang::yangTimeFormat(time, libyang::TimezoneInterpretation::Local));
+    }
+}
+BENCHMARK(BM_LibyangYangTimeFormat);
+}
+
+/** @short Run the microbenchmarks, by default with repetitions and with JSON output
+ *
+ * Any options of Google Benchmark can be passed on the command line, they override the defaults. Use, e.g.,
+ * `--benchmark_out=results.json --benchmark_out_format=json --benchmark_format=console` to keep the results
+ * in a file while watching the progress.
+ * */
+int main(int argc, char* argv[])
+{
+    std::string defaults[] = {
+        "--benchmark_repetitions=10",
+        "--benchmark_report_aggregates_only=true",
+        "--benchmark_format=json",
+    };
+    std::vector<char*> args{argv[0]};
+    for (auto& option : defaults) {
+        args.push_back(option.data());
+    }
+    args.insert(args.end(), argv + 1, argv + argc);
+    auto count = static_cast<int>(args.size());
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+        return 1;
+    }
+    benchmark::AddCustomContext("sysrepo-ietf-alarms", SYSREPO_IETF_ALARMS_VERSION);
+    alarms::utils::initLogs(std::make_shared<spdlog::sinks::null_sink_mt>());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "trompeloeil_doctest.h"
+#include <chrono>
+#include <cmath>
+#include "alarms/FlapDamping.h"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Flap damping")
+{
+    alarms::FlapDamping settings;
+    settings.halfLife = 10s;
+    settings.summaryInterval = 1s;
+    const auto start = alarms::TimePoint{} + 1000h;
+    alarms::FlapState state;
+
+    SECTION("A few flaps are tolerated")
+    {
+        REQUIRE(!state.flap(settings, start));
+        REQUIRE(!state.flap(settings, start + 1s));
+        REQUIRE(!state.flap(settings, start + 2s));
+        REQUIRE(!state.damped);
+    }
+
+    SECTION("Flapping every now and then never gets damped")
+    {
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(!state.flap(settings, start + i * 10s));
+        }
+        REQUIRE(!state.damped);
+        REQUIRE(state.penaltyAt(settings, start + 1000s) < settings.suppressThreshold);
+    }
+
+    SECTION("Rapid flapping")
+    {
+        REQUIRE(!state.flap(settings, start));
+        REQUIRE(!state.flap(settings, start));
+        REQUIRE(!state.flap(settings, start));
+        REQUIRE(state.flap(settings, start));
+        REQUIRE(state.damped);
+
+        // it is reported just once
+        REQUIRE(!state.flap(settings, start + 1s));
+        REQUIRE(state.damped);
+
+        SECTION("The penalty decays by one half per half-life")
+        {
+            auto penalty = state.penaltyAt(settings, start + 1s);
+            REQUIRE(std::abs(state.penaltyAt(settings, start + 11s) - penalty / 2) < 1e-6);
+            REQUIRE(std::abs(state.penaltyAt(settings, start + 21s) - penalty / 4) < 1e-6);
+
+            // the wall clock has been stepped back
+            REQUIRE(state.penaltyAt(settings, start) == penalty);
+        }
+
+        SECTION("Released once it has calmed down")
+        {
+            // 4000 * 2^(-1/10) + 1000 decays below 750 in about 2.7 half-lives
+            REQUIRE(!state.release(settings, start + 10s));
+            REQUIRE(!state.release(settings, start + 25s));
+            REQUIRE(state.damped);
+            REQUIRE(state.release(settings, start + 30s));
+            REQUIRE(!state.damped);
+            REQUIRE(!state.release(settings, start + 40s));
+        }
+
+        SECTION("The penalty has an upper bound")
+        {
+            for (int i = 0; i < 1000; ++i) {
+                state.flap(settings, start + 2s);
+            }
+            REQUIRE(state.penalty == settings.maxPenalty);
+
+            // 12000 -> 750 is four half-lives
+            REQUIRE(!state.release(settings, start + 41s));
+            REQUIRE(state.release(settings, start + 43s));
+        }
+    }
+}
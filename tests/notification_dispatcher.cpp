@@ -0,0 +1,70 @@
+#include "trompeloeil_doctest.h"
+#include <semaphore>
+#include "alarms/NotificationDispatcher.h"
+#include "test_log_setup.h"
+
+namespace {
+alarms::StatusChangeNotification notification(const std::string& resource, const int i)
+{
+    return {.key = {.type = {.id = "alarms-test:alarm-1", .qualifier = ""}, .resource = resource}, .time = alarms::TimePoint{std::chrono::seconds{i}}, .perceivedSeverity = 2, .text = std::to_string(i)};
+}
+}
+
+TEST_CASE("Notification dispatcher")
+{
+    TEST_INIT_LOGS;
+    std::vector<std::string> sent;
+
+    SECTION("Everything gets sent in order")
+    {
+        {
+            alarms::NotificationDispatcher dispatcher([&](const alarms::StatusChangeNotification& n) { sent.push_back(n.key.resource + "/" + n.text); }, 10'000);
+            for (int i = 0; i < 1000; ++i) {
+                REQUIRE(dispatcher.enqueue(notification(i % 2 ? "odd" : "even", i)));
+            }
+            // the destructor waits for the queued ones
+        }
+        REQUIRE(sent.size() == 1000);
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(sent[i] == (i % 2 ? "odd/" : "even/") + std::to_string(i));
+        }
+    }
+
+    SECTION("A slow sender does not block the queueing")
+    {
+        std::binary_semaphore entered{0}, release{0};
+        bool first = true;
+        auto slowSender = [&](const alarms::StatusChangeNotification& n) {
+            if (first) {
+                first = false;
+                entered.release();
+                release.acquire();
+            }
+            if (n.text == "3") {
+                throw std::runtime_error{"cannot send this one"};
+            }
+            sent.push_back(n.text);
+        };
+        std::optional<alarms::NotificationDispatcher> dispatcher;
+        dispatcher.emplace(slowSender, 3);
+
+        REQUIRE(dispatcher->enqueue(notification("r", 0)));
+        entered.acquire();
+        // now the dispatcher is stuck in sending #0, so the queue fills up
+        REQUIRE(dispatcher->enqueue(notification("r", 1)));
+        REQUIRE(dispatcher->enqueue(notification("r", 2)));
+        REQUIRE(dispatcher->enqueue(notification("r", 3)));
+        REQUIRE(!dispatcher->enqueue(notification("r", 4)));
+        REQUIRE(!dispatcher->enqueue(notification("r", 5)));
+
+        auto counters = dispatcher->counters();
+        REQUIRE(counters.depth == 3);
+        REQUIRE(counters.sent == 0);
+        REQUIRE(counters.dropped == 2);
+        REQUIRE(counters.failed == 0);
+
+        release.release();
+        dispatcher.reset();
+        REQUIRE(sent == std::vector<std::string>{"0", "1", "2"});
+    }
+}
@@ -0,0 +1,133 @@
+#include "trompeloeil_doctest.h"
+#include <sysrepo-cpp/Connection.hpp>
+#include "alarms/Identities.h"
+#include "alarms/Key.h"
+#include "alarms/ShelfMatch.h"
+#include "test_log_setup.h"
+#include "test_sysrepo_helpers.h"
+
+using namespace std::string_literals;
+
+namespace {
+const auto shelves = "/ietf-alarms:alarms/control/alarm-shelving/shelf"s;
+
+void addShelf(std::optional<libyang::DataNode>& config, const libyang::Context& ctx, const std::string& name, const std::vector<std::string>& resources, const std::vector<alarms::Type>& types)
+{
+    const auto prefix = shelves + "[name='" + name + "']";
+    if (!config) {
+        config = ctx.newPath(prefix);
+    } else {
+        config->newPath(prefix);
+    }
+    for (const auto& resource : resources) {
+        config->newPath(prefix + "/resource[.='" + resource + "']");
+    }
+    for (const auto& type : types) {
+        config->newPath(prefix + "/alarm-type[alarm-type-id='" + type.id + "'][alarm-type-qualifier-match='" + type.qualifier + "']");
+    }
+}
+
+alarms::InstanceKey key(const std::string& id, const std::string& qualifier, const std::string& resource)
+{
+    return {.type = {.id = id, .qualifier = qualifier}, .resource = resource};
+}
+}
+
+TEST_CASE("Identity derivation table")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    TEST_SYSREPO_CLIENT_INIT(sess);
+    alarms::IdentityTable identities;
+    REQUIRE(identities.update(sess->getContext()));
+    REQUIRE(!identities.update(sess->getContext()));
+
+    REQUIRE(identities.find("alarms-test:nope") == std::nullopt);
+    auto base = identities.find("alarms-test:base-alarm").value();
+    auto alarm2 = identities.find("alarms-test:alarm-2").value();
+    auto alarm21 = identities.find("alarms-test:alarm-2-1").value();
+    auto alarm1 = identities.find("alarms-test:alarm-1").value();
+
+    REQUIRE(identities.isDerivedFrom(alarm21, alarm21));
+    REQUIRE(identities.isDerivedFrom(alarm21, alarm2));
+    REQUIRE(identities.isDerivedFrom(alarm21, base));
+    REQUIRE(identities.isDerivedFrom(alarm1, base));
+    REQUIRE(!identities.isDerivedFrom(alarm1, alarm2));
+    REQUIRE(!identities.isDerivedFrom(alarm2, alarm21));
+    REQUIRE(!identities.isDerivedFrom(base, alarm1));
+}
+
+TEST_CASE("Compiled shelving rules")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    TEST_SYSREPO_CLIENT_INIT(sess);
+    auto ctx = sess->getContext();
+    alarms::IdentityTable identities;
+    REQUIRE(identities.update(ctx));
+    std::optional<libyang::DataNode> config;
+
+    SECTION("no shelves")
+    {
+        alarms::ShelvingRules rules;
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-1", "", "edfa"), identities) == std::nullopt);
+    }
+
+    SECTION("matching")
+    {
+        addShelf(config, ctx, "by-type", {}, {{"alarms-test:alarm-2", "high"}});
+        addShelf(config, ctx, "by-resource", {"edfa", "wss"}, {});
+        addShelf(config, ctx, "both", {"psu"}, {{"alarms-test:alarm-1", ""}});
+        addShelf(config, ctx, "everything", {}, {});
+        alarms::ShelvingRules rules(config->findXPath(shelves), identities);
+
+        // derived identities match as well, the qualifier must match exactly
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-2", "high", "psu"), identities) == "by-type");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-2-1", "high", "psu"), identities) == "by-type");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-2-2", "high", "edfa"), identities) == "by-type");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-2-2", "low", "edfa"), identities) == "by-resource");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-1", "", "psu"), identities) == "both");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-1", "x", "psu"), identities) == "everything");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:base-alarm", "high", "fan"), identities) == "everything");
+    }
+
+    SECTION("order of shelves is preserved")
+    {
+        addShelf(config, ctx, "any-resource", {}, {{"alarms-test:alarm-1", ""}});
+        addShelf(config, ctx, "edfa", {"edfa"}, {});
+        addShelf(config, ctx, "any-resource-2", {}, {{"alarms-test:alarm-2", ""}});
+        alarms::ShelvingRules rules(config->findXPath(shelves), identities);
+
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-1", "", "edfa"), identities) == "any-resource");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-2", "", "edfa"), identities) == "edfa");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-2", "", "wss"), identities) == "any-resource-2");
+        REQUIRE(rules.findMatchingShelf(key("alarms-test:alarm-1", "nope", "wss"), identities) == std::nullopt);
+    }
+}
+
+TEST_CASE("Shelving rules with many shelves")
+{
+    TEST_SYSREPO_INIT_LOGS;
+    TEST_SYSREPO_CLIENT_INIT(sess);
+    auto ctx = sess->getContext();
+    alarms::IdentityTable identities;
+    identities.update(ctx);
+
+    constexpr auto NUM_SHELVES = 100;
+    constexpr auto NUM_ALARMS = 1'000;
+
+    std::optional<libyang::DataNode> config;
+    for (int i = 0; i < NUM_SHELVES; ++i) {
+        addShelf(config, ctx, "shelf-" + std::to_string(i), {"resource-" + std::to_string(i)}, {{"alarms-test:alarm-2", ""}});
+    }
+    addShelf(config, ctx, "qualified", {}, {{"alarms-test:alarm-1", "shelve-me"}});
+    alarms::ShelvingRules rules(config->findXPath(shelves), identities);
+
+    int shelved = 0;
+    for (int i = 0; i < NUM_ALARMS; ++i) {
+        auto k = key(i % 2 ? "alarms-test:alarm-2-1" : "alarms-test:alarm-1", i % 4 ? "" : "shelve-me", "resource-" + std::to_string(i % (2 * NUM_SHELVES)));
+        k.type.identity = identities.find(k.type.id);
+        shelved += !!rules.findMatchingShelf(k, identities);
+    }
+
+    // odd alarms are alarm-2-1 on resources 0..199, only those below 100 have a shelf; every fourth alarm is qualified
+    REQUIRE(shelved == NUM_ALARMS / 4 + NUM_ALARMS / 4);
+}
@@ -0,0 +1,93 @@
+#include "trompeloeil_doctest.h"
+#include "alarms/StatusChangeHistory.h"
+
+namespace {
+alarms::TimePoint at(const int seconds)
+{
+    return alarms::TimePoint{std::chrono::seconds{seconds}};
+}
+
+std::vector<alarms::TimePoint> times(const alarms::StatusChangeHistory& history)
+{
+    std::vector<alarms::TimePoint> res;
+    for (size_t i = 0; i < history.size(); ++i) {
+        res.push_back(history[i].time);
+    }
+    return res;
+}
+}
+
+TEST_CASE("Status change history")
+{
+    alarms::StatusChangeHistory history;
+    std::vector<alarms::TimePoint> evicted;
+    auto recordEvicted = [&](const alarms::TimePoint& time) { evicted.push_back(time); };
+
+    SECTION("Unlimited")
+    {
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(!history.push({at(i), 1, "text"}));
+        }
+        REQUIRE(history.size() == 100);
+        REQUIRE(history[0].time == at(0));
+        REQUIRE(history[99].time == at(99));
+    }
+
+    SECTION("Limited")
+    {
+        history.setLimit(3, recordEvicted);
+        REQUIRE(!history.push({at(1), 1, "a"}));
+        REQUIRE(!history.push({at(2), 2, "b"}));
+        REQUIRE(!history.push({at(3), 3, "c"}));
+
+        // once full, each new entry replaces the oldest one
+        REQUIRE(history.push({at(4), 4, "d"}) == at(1));
+        REQUIRE(history.push({at(5), 5, "e"}) == at(2));
+        REQUIRE(times(history) == std::vector{at(3), at(4), at(5)});
+        REQUIRE(history[2].perceivedSeverity == 5);
+        REQUIRE(history[2].text == "e");
+
+        SECTION("Shrinking")
+        {
+            history.setLimit(1, recordEvicted);
+            REQUIRE(evicted == std::vector{at(3), at(4)});
+            REQUIRE(times(history) == std::vector{at(5)});
+            REQUIRE(history.push({at(6), 6, "f"}) == at(5));
+            REQUIRE(times(history) == std::vector{at(6)});
+        }
+
+        SECTION("Growing")
+        {
+            history.setLimit(5, recordEvicted);
+            REQUIRE(evicted.empty());
+            REQUIRE(!history.push({at(6), 6, "f"}));
+            REQUIRE(!history.push({at(7), 7, "g"}));
+            REQUIRE(history.push({at(8), 8, "h"}) == at(3));
+            REQUIRE(times(history) == std::vector{at(4), at(5), at(6), at(7), at(8)});
+        }
+
+        SECTION("Unlimited again")
+        {
+            history.setLimit(std::nullopt, recordEvicted);
+            REQUIRE(evicted.empty());
+            REQUIRE(!history.push({at(6), 6, "f"}));
+            REQUIRE(times(history) == std::vector{at(3), at(4), at(5), at(6)});
+        }
+
+        SECTION("Compressing")
+        {
+            history.keepNewest(1, recordEvicted);
+            REQUIRE(evicted == std::vector{at(3), at(4)});
+            REQUIRE(times(history) == std::vector{at(5)});
+            REQUIRE(history.limit() == 3);
+            REQUIRE(!history.push({at(6), 6, "f"}));
+        }
+    }
+
+    SECTION("No history at all")
+    {
+        history.setLimit(0, recordEvicted);
+        REQUIRE(history.push({at(1), 1, "a"}) == at(1));
+        REQUIRE(history.empty());
+    }
+}
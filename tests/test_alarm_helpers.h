@@ -5,16 +5,22 @@
  */
 
 #pragma once
+#include <filesystem>
 #include <map>
 #include <libyang-cpp/Time.hpp>
 #include <string>
 #include <test_time_interval.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+#include "alarms/Key.h"
 #include "utils/sysrepo.h"
 
 namespace {
 using namespace std::string_literals;
 
 const auto rpcPrefix = "/sysrepo-ietf-alarms:create-or-update-alarm";
+const auto batchRpcPrefix = "/sysrepo-ietf-alarms:create-or-update-alarms";
 
 const auto ietfAlarmsModule = "ietf-alarms";
 const auto ietfAlarms = "/ietf-alarms:alarms";
@@ -31,6 +37,27 @@ const auto controlShelf = "/ietf-alarms:alarms/control/alarm-shelving/shelf";
 const auto alarmStatusNotification = "/ietf-alarms:alarm-notification";
 const auto inventoryNotification = "/ietf-alarms:alarm-inventory-changed";
 
+/** @short Key of the i-th alarm, for the tests which feed the alarm cache directly; some of them are matched by the shelves of the benchmarks */
+inline alarms::InstanceKey testKey(const size_t i)
+{
+    return {.type = {.id = i % 2 ? "alarms-test:alarm-2-1" : "alarms-test:alarm-1", .qualifier = i % 4 ? "" : "shelve-me"}, .resource = "resource-" + std::to_string(i)};
+}
+
+/** @short An empty directory which is removed once this goes out of scope */
+struct TemporaryDirectory {
+    std::filesystem::path path;
+
+    explicit TemporaryDirectory(const std::string& name)
+        : path(std::filesystem::temp_directory_path() / (name + "-" + std::to_string(::getpid())))
+    {
+        std::filesystem::remove_all(path);
+    }
+
+    ~TemporaryDirectory()
+    {
+        std::filesystem::remove_all(path);
+    }
+};
 }
 
 #define CLIENT_ALARM_RPC(SESS, ID, QUALIFIER, RESOURCE, SEVERITY, TEXT) \
@@ -49,6 +76,38 @@ const auto inventoryNotification = "/ietf-alarms:alarm-inventory-changed";
         return AnyTimeBetween{intervalStart, intervalEnd}; \
     }()
 
+#define CLIENT_ALARM_BATCH_RPC(SESS, ALARMS, EXPECTED_OUTPUT) \
+    [&]() { \
+        std::map<std::string, std::string> inp; \
+        unsigned index = 0; \
+        for (const auto& [id, qualifier, resource, severity, text] : std::vector<std::tuple<std::string, std::string, std::string, std::string, std::string>> ALARMS) { \
+            const auto prefix = "alarm[index='" + std::to_string(++index) + "']"; \
+            inp[prefix + "/resource"] = resource; \
+            inp[prefix + "/alarm-type-id"] = id; \
+            inp[prefix + "/alarm-type-qualifier"] = qualifier; \
+            inp[prefix + "/severity"] = severity; \
+            inp[prefix + "/alarm-text"] = text; \
+        } \
+\
+        auto intervalStart = std::chrono::system_clock::now(); \
+        REQUIRE(rpcFromSysrepo(*SESS, batchRpcPrefix, inp) == std::map<std::string, std::string> EXPECTED_OUTPUT); \
+        auto intervalEnd = std::chrono::system_clock::now(); \
+        return AnyTimeBetween{intervalStart, intervalEnd}; \
+    }()
+
+#define BATCH_RESULT_IMPL(INDEX, RESOURCE, ALARM_TYPE_ID, ALARM_TYPE_QUALIFIER, RESULT) \
+    {"/alarm[index='" #INDEX "']", ""}, \
+    {"/alarm[index='" #INDEX "']/index", #INDEX}, \
+    {"/alarm[index='" #INDEX "']/resource", RESOURCE}, \
+    {"/alarm[index='" #INDEX "']/alarm-type-id", ALARM_TYPE_ID}, \
+    {"/alarm[index='" #INDEX "']/alarm-type-qualifier", ALARM_TYPE_QUALIFIER}, \
+    {"/alarm[index='" #INDEX "']/result", RESULT}
+
+#define BATCH_OK(INDEX, RESOURCE, ALARM_TYPE_ID, ALARM_TYPE_QUALIFIER) BATCH_RESULT_IMPL(INDEX, RESOURCE, ALARM_TYPE_ID, ALARM_TYPE_QUALIFIER, "ok")
+#define BATCH_REJECTED(INDEX, RESOURCE, ALARM_TYPE_ID, ALARM_TYPE_QUALIFIER, MESSAGE) \
+    BATCH_RESULT_IMPL(INDEX, RESOURCE, ALARM_TYPE_ID, ALARM_TYPE_QUALIFIER, "rejected"), \
+    {"/alarm[index='" #INDEX "']/error-message", MESSAGE}
+
 #define CLIENT_INTRODUCE_ALARM_VECTOR(SESS, ID, QUALIFIER, RESOURCES, SEVERITIES, DESCRIPTION) \
     { \
         alarms::utils::ScopedDatastoreSwitch s(*SESS, sysrepo::Datastore::Operational); \
@@ -0,0 +1,62 @@
+#include "trompeloeil_doctest.h"
+#include <algorithm>
+#include <libyang-cpp/Time.hpp>
+#include <random>
+#include "utils/time.h"
+
+namespace {
+std::string libyangUTC(const std::chrono::system_clock::time_point& timePoint)
+{
+    // libyang only knows "-00:00" for an unknown offset; UTC is the same instant, just with a different suffix
+    auto res = libyang::yangTimeFormat(timePoint, libyang::TimezoneInterpretation::Unspecified);
+    res.replace(res.size() - 6, 6, "+00:00");
+    return res;
+}
+}
+
+TEST_CASE("YANG timestamps")
+{
+    using namespace std::chrono_literals;
+    using std::chrono::system_clock;
+
+    alarms::utils::YangTimeFormatter local{alarms::utils::TimeZone::Local};
+    alarms::utils::YangTimeFormatter utc{alarms::utils::TimeZone::UTC};
+
+    std::vector<system_clock::time_point> timePoints;
+
+    SECTION("Known values")
+    {
+        REQUIRE(utc(system_clock::time_point{}) == "1970-01-01T00:00:00.000000000+00:00");
+        REQUIRE(utc(system_clock::time_point{1'700'000'000s + 123ms}) == "2023-11-14T22:13:20.123000000+00:00");
+        REQUIRE(utc(system_clock::time_point{-1ns}) == "1969-12-31T23:59:59.999999999+00:00");
+    }
+
+    SECTION("Each hour of a year, including the DST changes")
+    {
+        for (auto t = system_clock::time_point{1'672'531'200s} /* 2023-01-01 UTC */; t < system_clock::time_point{1'704'067'200s}; t += 1h) {
+            timePoints.push_back(t);
+            timePoints.push_back(t - 1ns);
+        }
+    }
+
+    SECTION("Random time points")
+    {
+        std::mt19937_64 rng{666};
+        std::uniform_int_distribution<int64_t> dist{-2'208'988'800 /* 1900 */, 7'258'118'400 /* 2200 */};
+        std::uniform_int_distribution<int64_t> fraction{0, 999'999'999};
+        for (int i = 0; i < 100'000; ++i) {
+            timePoints.push_back(system_clock::time_point{std::chrono::duration_cast<system_clock::duration>(std::chrono::seconds{dist(rng)} + std::chrono::nanoseconds{fraction(rng)})});
+        }
+    }
+
+    // going back and forth in time must not confuse the cached offset
+    std::shuffle(timePoints.begin() + timePoints.size() / 2, timePoints.end(), std::mt19937{666});
+
+    for (const auto& t : timePoints) {
+        REQUIRE(local(t) == libyang::yangTimeFormat(t, libyang::TimezoneInterpretation::Local));
+        REQUIRE(utc(t) == libyangUTC(t));
+
+        alarms::utils::YangTimeFormatter::Buffer buffer;
+        REQUIRE(local.format(t, buffer) == local(t));
+    }
+}